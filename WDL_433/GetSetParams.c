@@ -43,12 +43,17 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <errno.h>
+#include <setjmp.h>
 #include <getopt.h>
 #include "GetSetParams.h"
 #include "WDL_433.h"
 
 // Section header for aliases in .ini file
 #define ALIASES "aliases"
+#define POLICY  "policy"
+#define VIEWS   "views"
+#define FILTERS "filters"
 
 // GDEBUG is for debugging this procedure
 // DEBUG is for general debugging outside of this procedure
@@ -56,6 +61,31 @@ extern bool GDEBUG;
 extern bool DEBUG;
 extern NPTR sensors;
 
+// The .ini file processed, to be reloaded on SIGHUP, and where an invalid
+//   entry returns to while it's being reloaded
+static char    iniPath[PATH_MAX] = "";
+static bool    reloading = false;
+static jmp_buf reloadJump;
+
+// A setter has reported an invalid .ini entry: fatal at startup, but on
+//   reload only abandons the reload, leaving the configuration as it was
+void iniInvalid(void) {
+    if (reloading) longjmp(reloadJump, 1);
+    exit(EXIT_FAILURE);
+};
+
+// Record the [aliases] entry 'sensorID = alias' in 'sensors'
+static void setAlias(char *sensorID, char *alias) {
+    NPTR node = node_find(sensors, sensorID, true);
+    if (sensors == NULL) sensors = node;
+    if (node == NULL) {
+        fprintf(stderr, "Couldn't record alias for sensorID %s\n", sensorID);
+        return;
+    };
+    free(node->alias);
+    node->alias = strdup(alias);
+};
+
 /*
     Start by validating that the indices between 'long_opt' and
     the 'optaux' tables are referring to the same commands.
@@ -114,13 +144,13 @@ void GetSetParams(int argc, char *argv[], cmdlist_t *cmdlist) {
                 
             // set DEBUG?
             case 'D':
-                DEBUG = true;
+                setDebug();
                 printf("'--debug' enabled from command line\n");
                 break;
 
             // set GDEBUG?
             case 'G':
-                GDEBUG = true;
+                setGDebug();
                 printf("'--Gdebug' enabled from command line\n");
                 break;
 
@@ -194,21 +224,40 @@ void GetSetParams(int argc, char *argv[], cmdlist_t *cmdlist) {
             // Is this an alias?
             strLower(data.entries[i].section);
             foundAlias = (strcmp(data.entries[i].section, ALIASES) == 0) ? true : false;
+            // A pattern, with wildcards or an id range?  Add it to those
+            //   matched against each new sensorID, in the order given
+            if (foundAlias && aliasPattern(data.entries[i].key)) {
+                if (GDEBUG)
+                    printf("\tAlias pattern %s = %s \n", data.entries[i].key, data.entries[i].value);
+                setAliasPattern(data.entries[i].key, data.entries[i].value);
+                continue;
+            };
             if (foundAlias) {
                 // Yes, record the alias in 'sensors'
                 if (GDEBUG)
                     printf("\tAlias %s = %s \n", data.entries[i].key, data.entries[i].value);
-                NPTR node;
-                node = node_find(sensors, data.entries[i].key,true);
-                if (sensors == NULL) sensors = node;
-                if (node == NULL) {
-                    fprintf(stderr, "Couldn't record alias for sensorID %s\n",
-                                    data.entries[i].key);
-                } else {
-                    char *newalias = malloc(sizeof(data.entries[i].value));
-                    strcpy(newalias, data.entries[i].value);
-                    node->alias = newalias;
-                };
+                setAlias(data.entries[i].key, data.entries[i].value);
+            };
+            // Is this a recording policy?  Record it, by sensorID or alias
+            if (!foundAlias && (strcmp(data.entries[i].section, POLICY) == 0) ) {
+                if (GDEBUG)
+                    printf("\tPolicy %s = %s \n", data.entries[i].key, data.entries[i].value);
+                setPolicy(data.entries[i].key, data.entries[i].value);
+                continue;
+            };
+            // Is this a chart view?  Record it, to be kept up to date
+            if (!foundAlias && (strcmp(data.entries[i].section, VIEWS) == 0) ) {
+                if (GDEBUG)
+                    printf("\tView %s = %s \n", data.entries[i].key, data.entries[i].value);
+                setView(data.entries[i].key, data.entries[i].value);
+                continue;
+            };
+            // Is this a packet filter rule?  Record it, to be compiled
+            if (!foundAlias && (strcmp(data.entries[i].section, FILTERS) == 0) ) {
+                if (GDEBUG)
+                    printf("\tFilter %s = %s \n", data.entries[i].key, data.entries[i].value);
+                setFilter(data.entries[i].key, data.entries[i].value);
+                continue;
             };
             if (!foundAlias) {
                 // Is this key in the list of commands?
@@ -235,12 +284,17 @@ void GetSetParams(int argc, char *argv[], cmdlist_t *cmdlist) {
                     };
             };  // !foundAlias
         };
+        // Put the alias patterns and recording policies read in force
+        aliasInit();
+        policyInit();
         if (GDEBUG) {
             printf("Table of sensor aliases created from aliases in the .ini file:\n");
             tree_print(sensors);
         };
         freeIniData(&data);
         fclose(cFile);
+        // Keep its full path: the working directory may change
+        if (realpath(iniFile, iniPath) == NULL) strcpy(iniPath, iniFile);
     };  //finished processing .ini file
     if (GDEBUG) printf("Finished processing the .ini file\n");
 
@@ -289,6 +343,80 @@ void GetSetParams(int argc, char *argv[], cmdlist_t *cmdlist) {
     };
 };  // end GetSetParams()
 
+/*
+    Reload the [aliases], [policy] and [filters] sections of the .ini
+    file, on SIGHUP, without a restart.  The new alias patterns, policies
+    and filter rules are built to the side of those in force, and put in
+    force, one table after another on this (the main) thread, only once
+    the whole file has been read without error, so packets are never
+    decided by a part-built table and an invalid entry leaves the
+    configuration as it was.  Sensors keep their recording state: the
+    times and readings they were last recorded with.  Other settings,
+    and [views], take effect when WDL_433 is restarted.
+*/
+void ReloadParams(void) {
+    FILE   *cFile;
+    IniData data;
+    int     i, naliases = 0, npolicies = 0, nfilters = 0;
+
+    if (iniPath[0] == '\0') {
+        LOG(LM_PARAMS, LV_WARN, "No .ini file to reload\n");
+        return;
+    };
+    if ( (cFile = fopen(iniPath, "r")) == NULL ) {
+        LOG(LM_PARAMS, LV_ERR, "Can't reload '%s': %s\n", iniPath, strerror(errno));
+        return;
+    };
+    initIniData(&data);
+    if (!parseIniFile(cFile, &data)) {
+        LOG(LM_PARAMS, LV_ERR, "Can't reload '%s': it can't be parsed\n", iniPath);
+        return;
+    };
+    fclose(cFile);
+
+    reloading = true;
+    if (setjmp(reloadJump) != 0) {
+        // A setter found an invalid entry and has said what it is
+        reloading = false;
+        aliasAbort();
+        policyAbort();
+        filterAbort();
+        freeIniData(&data);
+        LOG(LM_PARAMS, LV_ERR, "Reload of '%s' abandoned: the configuration is unchanged\n",
+            iniPath);
+        return;
+    };
+    for (i = 0; i < data.count; i++) {
+        strLower(data.entries[i].section);
+        if (strcmp(data.entries[i].section, ALIASES) == 0) {
+            if (aliasPattern(data.entries[i].key))
+                setAliasPattern(data.entries[i].key, data.entries[i].value);
+            naliases++;
+        } else if (strcmp(data.entries[i].section, POLICY) == 0) {
+            setPolicy(data.entries[i].key, data.entries[i].value);
+            npolicies++;
+        } else if (strcmp(data.entries[i].section, FILTERS) == 0) {
+            setFilter(data.entries[i].key, data.entries[i].value);
+            nfilters++;
+        };
+    };
+    // Compiling the rules is the last step that can fail
+    filterInit();
+    reloading = false;
+
+    // Give each sensor the alias the new patterns give it, unless it has
+    //   its own entry, and find its policy again when it's next recorded
+    aliasInit();
+    aliasApply(sensors);
+    for (i = 0; i < data.count; i++)
+        if ( (strcmp(data.entries[i].section, ALIASES) == 0) && !aliasPattern(data.entries[i].key) )
+            setAlias(data.entries[i].key, data.entries[i].value);
+    policyInit();
+    freeIniData(&data);
+    LOG(LM_PARAMS, LV_INFO, "Reloaded '%s': %d aliases, %d policies, %d filter rules\n",
+        iniPath, naliases, npolicies, nfilters);
+};
+
 
 /*
     The key:value data from the .ini are stored into a table for
@@ -21,7 +21,6 @@
 #include <string.h>
 #include <stdbool.h>
 #include <getopt.h>
-#include <mosquitto.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
@@ -31,6 +30,7 @@
 #include "mjson.h"
 
 void GetSetParams(int argc, char *argv[], cmdlist_t *cmdlist);
+void ReloadParams(void);
 
 // Make operating parameters global so all modules can see them
 bool     DEBUG    = false; 
@@ -39,27 +39,39 @@ source_t source   = MQTT;
 char    *host     = "";
 int      port     = 1883;
 char    *topic    = "";
+char    *models   = "";
+char    *noModels = "";
+char    *shareGroup = "";
+char    *instance = "";
 NPTR    sensors   = NULL;
+double   lagBudget = LAG_BUDGET;
+char    *stateFile = STATE_FILE;
+char    *spoolFile = SPOOL_FILE;
+char    *pubTopic  = "";
+aggregate_t aggregate = AGG_OFF;
+char    *httpAddr  = "";
+char    *viewDir   = "";
+char    *latestName = "";
+char    *captureDir  = "";
+char    *captureKeep = "";
 
-#ifdef USE_SQLITE3
-bool   usingSql3 = true;
-char   *sql3path = DBPATH;
-char   *sql3file = DBNAME".db";
-#else
-bool   usingSql3  = false;;
+char   *backend   = BACKEND;
+char   *sql3path  = DBPATH;
+char   *sql3file  = DBNAME".db";
 char   *myHost    = "";
 char   *myUser    = "";
 char   *myPass    = "";
-#endif
+char   *dataFile  = DATA_FILE;
+
+bool    importMode = false;   // --import: load files named on the command line
+bool    bulkLoad   = false;   // the sinks are loading history, not live packets
 
-struct mosquitto *mosq;
 bool run = true;
 char lastSensorID[201] = "";
 time_t timestamp;
 char id[20];
 char chnl[20];
 time_t lasttime = (time_t) 0x00000000;
-struct tm tm;
 char paths[] = INI_PATH;
 char *path;
 DBRecord  DBRow;
@@ -79,120 +91,161 @@ const struct json_attr_t json_rtl[] = {
   {NULL}
 };
 
-void handle_signal(int s) {
-    run = false;
-    mosquitto_disconnect(mosq);
-}
+// Is this a packet WDL_433 might record?
+// The rules in the [filters] section decide, if there are any (see WDL_filter.c);
+// otherwise, ignores tire pressure messages and messages that don't have temperature readings
+bool wantMessage(char *payload) {
+    if (filterActive()) return filterPacket(payload);
+    // [NOTPMS] Ignore tire pressure readings
+    if (strstr(payload, "TPMS") != NULL) return false;
+    // [REQUIRETEMPERATURES] Ignore if message doesn't have a temperature reading
+    if (strstr(payload, "temperature") == NULL) return false;
+    return true;
+};
 
-// This is called when the MQTT connection to the server has been made or
-//   re-established.  It subscribes or re-subscribes to the topic so that
-//   messages will be received and processed by the message callback routine..
-void connect_callback(struct mosquitto *mosq, void *obj, int connack_code) {
-    if (DEBUG) {
-        printf("MQTT connect callback, result code = %d\n", connack_code);
-        printf("MQTT result msg: %s\n", mosquitto_connack_string(connack_code));
+// Deserialize a packet into 'row', with its sensorID made 'model'/'id'/'chnl'
+//   and its time in 'row->rxtime'.  Uses its own copy of json_rtl[], pointing
+//   into 'row', rather than the globals, so packets can be parsed by several
+//   threads at once (see WDL_import.c).  False if it can't be parsed.
+bool parseMessage(char *payload, DBRecord *row) {
+    struct json_attr_t attrs[sizeof(json_rtl)/sizeof(json_rtl[0])];
+    char   rowid[sizeof(id)], rowchnl[sizeof(chnl)], *a;
+    struct tm rowtm;
+    int    jstatus;
+
+    memcpy(attrs, json_rtl, sizeof(attrs));
+    for (int i = 0; attrs[i].attribute != NULL; i++) {
+        a = attrs[i].addr.string;
+        if ( (a >= (char *)&DBRow) && (a < (char *)(&DBRow + 1)) )
+            attrs[i].addr.string = (char *)row + (a - (char *)&DBRow);
+        else if (a == id)
+            attrs[i].addr.string = rowid;
+        else if (a == chnl)
+            attrs[i].addr.string = rowchnl;
     };
-    if (connack_code >= 0x80) {
-        fprintf(stderr,"MQTT connection failed with error code %d!\n", connack_code);
-        exit(EXIT_FAILURE);
-    }
-    int rc = mosquitto_subscribe(mosq, NULL, topic, 0);
-    if (rc != MOSQ_ERR_SUCCESS) {
-        fprintf(stderr, "?Couldn't subscribe to MQTT server '%s', port %d, topic '%s'\n",
-                host, port, topic);
-        fprintf(stderr, "Subscription error code %d, \n   %s\n",
-                rc, mosquitto_reason_string(rc));
-        fprintf(stderr, "Verify that the topic and port are correct\n");
-        exit(EXIT_FAILURE);
+    memset(row, 0, sizeof(DBRecord));
+    jstatus = json_read_object(payload, attrs, NULL);
+    // If not successful, say so and give up on this record
+    if (jstatus != 0) {
+        LOG(LM_MAIN, LV_WARN, "%s\n", json_error_string(jstatus));
+        return false;
     };
-};
-
-// This processes the JSON packets as received by the MQTT client procedure
-// Ignores tire pressure messages and messages that don't have temperature
-// readings.  Only records messages from any individual sensor approximately
-// every 5 minutes.
-void message_callback(struct mosquitto *mosq, void *obj,
-                      const struct mosquitto_message *message) {
-    int jstatus;
+    // Convert the time string to a 'time_t' entity for comparisons
+    memset(&rowtm, 0, sizeof(rowtm));
+    strptime(row->date_time, "%Y-%m-%d %H:%M:%S", &rowtm);
+    rowtm.tm_isdst = -1;
+    row->rxtime = mktime(&rowtm);
 
-    // [NOTPMS] Ignore tire pressure readings
-    if (strstr(message->payload, "TPMS") != NULL) return;
-    // [REQUIRETEMPERATURES] Ignore if message doesn't have a temperature reading
-    if (strstr(message->payload, "temperature") == NULL) return;
-    // Got a message: deserialize it
-      jstatus = json_read_object(message->payload, json_rtl, NULL);
-      // If not successful, say so and give up on this record
-      if (jstatus != 0) {
-          fprintf(stderr,json_error_string(jstatus));
-          return;
-      };
-      // Convert the time string to a 'time_t' entity for comparisons
-      strptime(DBRow.date_time, "%Y-%m-%d %H:%M:%S", &tm);
-      tm.tm_isdst = 1;
-      timestamp = mktime(&tm);
+    // Append the 'id' and 'chnl' fields to 'sensorID' to make
+    // 'model'/'id'/'chnl' the key to use for identifying the sensor
+    // and for de-duplicating records
+    strcat(row->sensorID, "/"); strcat(row->sensorID, rowid);
+    strcat(row->sensorID, "/"); strcat(row->sensorID, rowchnl);
+    return true;
+};
 
-      // The statements below appends the 'id' and 'chnl' fields to
-      // 'sensorID' to make 'model'/'id'/'chnl' the key to use
-      // for identifying the sensor and for de-duplicating records
-      strcat(DBRow.sensorID, "/"); strcat(DBRow.sensorID, id);
-      strcat(DBRow.sensorID, "/"); strcat(DBRow.sensorID, chnl);
+// Apply the de-duplication and recording-interval rules to a parsed packet,
+// and record it if they allow.  Packets must arrive in time order.
+void recordMessage(DBRecord *row) {
+      timestamp = row->rxtime;
 
       // Now de-dup the packets as received: Ignore duplicated readings in the same message
       // If sensorID has not changed or time < 2 sec since last record, ignore it
-      if ( (strcmp(DBRow.sensorID, lastSensorID) == 0) &&
+      if ( (strcmp(row->sensorID, lastSensorID) == 0) &&
            (timestamp < lasttime+DUP_REC) ) return;
 
       // OK, need to record the data for this sensor.
       // First, see if we've seen it since startup so we can record this timestamp
       //   and if we haven't seen it before, create a new node
-      NPTR node = node_find(sensors,DBRow.sensorID,true);
+      NPTR node = node_find(sensors,row->sensorID,true);
       if (sensors == NULL) sensors = node;
       if (node == NULL) {
-        fprintf(stderr, "Couldn't record for sensorID %s\n", DBRow.sensorID);
+        LOG(LM_MAIN, LV_ERR, "Couldn't record for sensorID %s\n", row->sensorID);
         return;
       };
       
       // Record its sensorID and timestamp so we can wait for
       // 'DUP_REC' seconds before making another entry
-      strcpy(lastSensorID, DBRow.sensorID);
+      strcpy(lastSensorID, row->sensorID);
       lasttime = timestamp;
 
-      // If we've seen this sensorID less than 'recordingInterva' seconds
-      // in the past, don't record it now
-      if (timestamp < node->lasttime+recordingInterval) return;
-      
+      // Record it only if its recording policy says to: if it has changed
+      // enough, or hasn't been recorded for long enough
+      if (!policyRecord(node, row)) return;
+      recordRow(node, row);
+      return;
+};
+
+// Record 'row', the reading (or window of readings) from the sensor at 'node'
+void recordRow(NPTR node, DBRecord *row) {
       // If there is a known alias for this sensor, use it in the database entry
-      if (node->alias != NULL) strcpy(DBRow.sensorID, node->alias);
+      if (node->alias != NULL) strcpy(row->sensorID, node->alias);
 
-      // Append this entry to the database and note the recording 
-      appendToDB(&DBRow);
-      node->lasttime = timestamp;
+      // Append this entry to the database (or spool) and note the recording 
+      row->node = node;
+      storeRecord(row);
+      publishRecord(row);
+      policyRecorded(node, row);
       
-      if (DEBUG) 
-          printf("%s: %20s, %5.1f\u00B0C\t%5.1f\u00B0C\t%4.0f%% RH\t%6.1f h_Pa\t%4.0f%% light\n",
-                 DBRow.date_time, DBRow.sensorID,
-                 DBRow.temp1, DBRow.temp2,
-                 DBRow.rh, DBRow.press, DBRow.light);
-      return;
+      if (LOGGING(LM_MAIN, LV_DEBUG)) logRow(LM_MAIN, LV_DEBUG, row);
+};
+
+// This processes the JSON packets as received from the packet source
+// Records messages from any individual sensor as its recording policy
+// allows (by default, approximately every 5 minutes).
+void processMessage(char *payload) {
+    if (!wantMessage(payload)) return;
+    // Got a message: deserialize it (keeping it, as received, in the
+    //   capture log if there is one, even if it can't be)
+    if (!parseMessage(payload, &DBRow)) {
+        captureRaw(payload);
+        return;
+    };
+    // If several instances share the feed, leave this sensor's packets to
+    //   its owner, which captures them, so each is captured just once
+    if (!shareMine(DBRow.sensorID, payload)) return;
+    captureRaw(payload);
+    recordMessage(&DBRow);
+};
+
+// Signals arrive through the event loop: stop on SIGINT or SIGTERM,
+//   reload aliases, policies and filter rules from the .ini file on SIGHUP,
+//   report the sensors and their lags on SIGUSR1
+void handle_signal(int signo, void *arg) {
+    switch (signo) {
+    case SIGINT:
+    case SIGTERM:
+        run = false;
+        evStop(mainLoop);
+        break;
+    case SIGUSR1:
+        printf("Sensors recorded in this session:\n");
+        tree_print(sensors);
+        lagReport();
+        filterPrint();
+        fflush(stdout);
+        break;
+    case SIGHUP:
+        ReloadParams();
+        break;
+    };
 };
 
 /*
     The main procedure first sets the operational parameters, by default values,
     .ini (configuration) file, or command-line processing; checks that the
-    database can be accessed; then subscribes to the designated publication stream
-    from the rtl_433 server and lets those packets be processed by the
-    MQTT callback procedure until the program is terminated.
+    database can be accessed; then opens the packet source (normally the
+    subscription to the designated publication stream from the rtl_433
+    server) and runs the event loop, which processes those packets and
+    the program's periodic work, until the program is terminated.
 */
 int main(int argc, char *argv[]) {
 // Instantiate the command list and options auxilliary tables
 #include "WDL_cmds.c"
-    uint8_t reconnect = true;
-    char clientid[24];
-    enum mosq_err_t rc;
-    const int KEEPALIVE = 60;
-    
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+
+    // Signals are handled by the event loop; block them before
+    // any threads are created so that none of those threads gets them
+    evBlockSignals();
 
     printf("WDL_433: Weather station data logger for rtl_433 servers\n");
 
@@ -206,47 +259,74 @@ int main(int argc, char *argv[]) {
             "Final values for operating parameters after .ini and CLI processing");
         printf("Sensor aliases from .ini file: \n");
         tree_print(sensors);
+        aliasPrint();
+        policyPrint();
     };
 
-  // Create the MQTT client
-    if (DEBUG) printf("Opening MQTT connection & subscribing\n",
-                      "Host: %s, port %d, topic: %s\n",
-                      host, port, topic);
-    mosquitto_lib_init();
-    snprintf(clientid, sizeof(clientid), "WDL_433_%d", getpid());
-    mosq = mosquitto_new(clientid, true, 0);
-    if (mosq == NULL) {
-        fprintf(stderr, "?WDL_433: Unable to create mosquitto client\n");
-        exit(EXIT_FAILURE);
-    };
-    
-    // Check for database file or open MySQL connection
-    initDBMgr();
-
-    //  Connect to the MQTT feed and subscribe in connect_callback
-    if (DEBUG) printf("Subscribing to MQTT feed\n");
-    mosquitto_connect_callback_set(mosq, connect_callback);
-    mosquitto_message_callback_set(mosq, message_callback);
-    rc = mosquitto_connect(mosq, host, port, KEEPALIVE);
-    if (rc != MOSQ_ERR_SUCCESS) {
-        fprintf(stderr, "?WDL_433: Couldn't connect to MQTT server\n");
-        fprintf(stderr, "Verify that host '%s' is publishing MQTT on port %d,\n",
-                host, port);
-        exit(EXIT_FAILURE);
+    // Start the logging thread now that log levels have been set
+    logStart();
+
+    // Compile the packet filter rules
+    filterInit();
+
+    mainLoop = evNew();
+
+    // Import history from the files named on the command line, rather
+    // than recording packets as they are received
+    if (importMode) {
+        importFiles(argc - optind, argv + optind);
+        logStop();
+        evFree(mainLoop);
+        exit(EXIT_SUCCESS);
     };
 
-    // Main loop: run until signaled not to by CNTL-C
-    // Enter wait loop with 30-sec timeout for disconnects
-    // loop_forever() handles reconnects if server disconnects
-    if (DEBUG) printf("Entering MQTT run loop\n");
-    rc = mosquitto_loop_forever(mosq, 30000, 1);
+    evSignals(mainLoop, handle_signal, NULL);
+
+    // Set up a sink for each storage backend: check for the database
+    // file or open the MySQL connection, and open the spool for records
+    // the database can't take
+    storeInit();
+
+    // Restore the sensor registry saved when we last stopped,
+    // and save it periodically from now on
+    stateLoad();
+    evTimer(mainLoop, STATE_INTERVAL*1000, true, stateTimer, NULL);
+
+    // Start the sinks' writer threads, and record the windows of sensors
+    // that have gone quiet
+    storeStart();
+    policyOpen();
+
+    // Open the capture log for the packets received
+    captureOpen();
+
+    // Connect to the MQTT feed (or other source of packets)
+    publishInit();
+    httpOpen();
+    viewOpen();
+    latestOpen();
+    sourceOpen();
+
+    // Main loop: run until signaled to stop by CNTL-C or SIGTERM
+    // (or until the end of input from stdin)
+    if (DEBUG) printf("Entering event loop\n");
+    evRun(mainLoop);
 
     // Exit here when told to stop; clean up
-    mosquitto_destroy(mosq);
+    policyClose();
+    sourceClose();
+    httpClose();
+    captureClose();
+    storeClose();
+    viewClose();
+    latestClose();
+    stateSave();
+    logStop();
     if (DEBUG) {
         printf("Sensors recorded in this session:\n");
         tree_print(sensors);
+        lagReport();
+        filterPrint();
     };
-    mosquitto_lib_cleanup();
+    evFree(mainLoop);
 };
-
@@ -20,26 +20,58 @@
 
 // max time difference, in sec, for two records from same sensor not to be duplicates
 #define DUP_REC 2  
-// minimum time between archived database records for each sensor, in sec
+// time between archived database records for each sensor, in sec, unless
+//   the [policy] section of the .ini file sets a different one
 #define recordingInterval 5*60   
+// default budget, in sec, for lag from rtl_433 receive time to database commit
+#define LAG_BUDGET 30
+// difference, in sec, between a sensor's average lag and the overall
+//   average lag that suggests its receiver's clock has drifted
+#define LAG_DRIFT 2
+// time, in sec, between snapshots of the sensor registry to the state file
+#define STATE_INTERVAL 5*60
+#define STATE_FILE DBPATH APP_NAME".state"
+// records that can't be written to the database wait in the spool file;
+//   the database is retried every SPOOL_RETRY sec and the spool is
+//   replayed in batches of SPOOL_BATCH records
+#define SPOOL_FILE DBPATH APP_NAME".spool"
+#define SPOOL_RETRY 10
+#define SPOOL_BATCH 500
+// records per batch when importing history with --import
+#define IMPORT_BATCH 50000
 
-#ifndef USE_SQLITE3
+// Raw capture log: packets are compressed in blocks of up to CAP_BLOCK
+//   bytes, written at least every CAP_FLUSH sec, to segments of up to
+//   CAP_SEGMENT bytes
+#define CAP_BLOCK   (64*1024)
+#define CAP_FLUSH   60
+#define CAP_SEGMENT (64L*1024*1024)
+#define CAP_MAGIC   0x50414357          // "WCAP"
+
+// Storage backend used unless 'backend' selects another; MySQL
+//   is available only if WDL_433 is made with USE_MYSQL=1
 #ifdef USE_MYSQL
-  #include <mariadb/mysql.h>
+  #define BACKEND "mysql"
 #else
-  #define USE_SQLITE3
-  #include <sqlite3.h>
-#endif // end ifdef USE_MYSQL
-#endif // end ifndef USE_SQLITE3
+  #define BACKEND "sqlite3"
+#endif
+#define DATA_FILE DBPATH DBNAME".dat"
 
 // File-handling definitions
 #define FNLEN      NAME_MAX
 #define INI_PATH   ".:~:/usr/local/etc:/etc"      // search path for .ini & aliases
 #define INI_FILE   APP_NAME".ini"                 // default name of .ini file
 
-typedef enum {HTTP, MQTT} source_t;               // future HTTP streaming option
+typedef enum {HTTP, MQTT, UDP, STDIN} source_t;   // HTTP is a future streaming option
+
+// Readings can be recorded as the first in each window, or as the
+//   window's mean, with or without its minimum and maximum
+typedef enum {AGG_OFF, AGG_MEAN, AGG_MINMAX} aggregate_t;
+#define AGG_FIELDS 5                    // temp1, temp2, rh, press, light
 
 // This is the structure to store data for database records
+// 'min' and 'max' are recorded only with 'aggregate = minmax'
+// 'rxtime' and 'node' are not recorded; they track the record's freshness
 typedef struct {
     char    date_time[20];;
     char    sensorID[50];
@@ -48,31 +80,105 @@ typedef struct {
     double  rh;
     double  press;
     double  light;
+    double  min[AGG_FIELDS];
+    double  max[AGG_FIELDS];
+    time_t  rxtime;
+    struct node *node;
 } DBRecord;
 
+// Rolling statistics for the lag, in sec, from rtl_433 receive time
+//   ('time' field of the JSON packet) until the record is committed
+typedef struct {
+    unsigned long count;
+    unsigned long violations;   // count of lags over 'lagBudget'
+    bool          over;         // most recent lag was over budget
+    double        last;
+    double        avg;          // exponentially-weighted moving average
+    double        min;
+    double        max;
+} lagstat_t;
+
+// Recording policy for a sensor: the deadbands, indexed by POL_TEMP etc.,
+//   are in the units recorded; 0 = not used, -1 = the default policy's
+typedef enum {POL_TEMP=0, POL_RH, POL_PRESS, POL_LIGHT, POL_BANDS} polband_t;
+typedef struct policy {
+    char          *name;        // sensorID or alias; NULL for the default
+    int            min;         // sec
+    int            max;         // sec
+    double         band[POL_BANDS];
+    struct policy *next;
+} policy_t;
 
 // We need the binary-tree node structure for procedures below
 typedef struct node {
     char          *key;
     char          *alias;
     time_t         lasttime;
+    policy_t      *policy;      // found when the sensor is first recorded
+    bool           haveLast;    // 'last' holds the values last recorded
+    struct {
+        double temp1, temp2, rh, press, light;
+    } last;
+    struct {                    // readings since last recorded, if aggregating
+        int    count;
+        double sum[AGG_FIELDS], min[AGG_FIELDS], max[AGG_FIELDS];
+        time_t opened;          // when its first reading arrived (our clock)
+        time_t rxtime;          // and the time and values of its last reading
+        char   date_time[20];
+        double last[AGG_FIELDS];
+    } agg;
+    lagstat_t      lag;
     struct node   *lptr;
     struct node   *rptr;
 } NODE, *NPTR;
 
 //  We need the cmdlist_t definitions for the handlers below
 #include "GetSetParams.h"
+//  and the logging definitions, which use DBRecord
+#include "WDL_log.h"
+//  and the event loop that drives everything
+#include "WDL_evloop.h"
 
 // General utility procedures
-void intHandler(int sigType);
+void processMessage(char *payload);
+bool wantMessage(char *payload);
+// Packet filter rules from the [filters] section, compiled at startup and on reload
+void setFilter(char *name, char *rule);
+void filterInit(void);
+void filterAbort(void);
+bool filterActive(void);
+bool filterPacket(const char *payload);
+void filterPrint(void);
+bool parseMessage(char *payload, DBRecord *row);
+void recordMessage(DBRecord *row);
+void recordRow(NPTR node, DBRecord *row);
 void strLower(char* s);
 bool isnumeric(char *str);
 void PrintParams(cmdlist_t *cmdlist, char *header);
 NPTR node_find(NPTR p, char *key, bool Create);
+// [aliases] patterns, matched when a sensorID is first seen
+bool aliasPattern(char *key);
+void setAliasPattern(char *pattern, char *alias);
+char *aliasMatch(char *sensorID);
+bool aliasByPattern(const char *alias);
+void aliasPrint(void);
+void aliasInit(void);
+void aliasAbort(void);
+void aliasApply(NPTR p);
+bool policyRecord(NPTR node, DBRecord *row);
+void policyRecorded(NPTR node, DBRecord *row);
+void policyPrint(void);
+void policyInit(void);
+void policyAbort(void);
+void policyOpen(void);
+void policyClose(void);
+extern const char *aggFields[AGG_FIELDS];
+extern const int   aggDigits[AGG_FIELDS];
 void tree_print(NPTR p);
 
 
 // .ini and CLI setters
+void iniInvalid(void);
 void setDebug(void);
 void setGDebug(void);
 void helper(cmdlist_t *cmdlist);
@@ -80,16 +186,138 @@ void setSource(char *optarg);
 void setHost(char *optarg);
 void setPort(char *optarg);
 void setTopic(char *optarg);
+void setPolicy(char *name, char *settings);
+void setAggregate(char *optarg);
+void setModels(char *optarg);
+void setNoModels(char *optarg);
+void setLagBudget(char *optarg);
+
+// Freshness (receive-to-commit lag) tracking
+void freshRecord(DBRecord *DBRow);
+void lagReport(void);
+
+// Sensor registry state save and restore
+void setStateFile(char *optarg);
+void stateLoad(void);
+void stateSave(void);
+void stateTimer(void *arg);
+
+// Packet sources
+void sourceOpen(void);
+void sourceClose(void);
+
+// Spool of records waiting for the database
+typedef struct spool spool_t;
+spool_t *spoolOpen(char *path);
+void spoolClose(spool_t *sp);
+long spoolCount(spool_t *sp);
+bool spoolAppend(spool_t *sp, DBRecord *rows, int n);
+int  spoolPeek(spool_t *sp, DBRecord **rows, int max);
+void spoolConsume(spool_t *sp, int n);
+
+// Storage: each sink delivers records to its backend, or to its spool
+//   while the backend is unavailable
+typedef struct sink sink_t;
+void setSpoolFile(char *optarg);
+void storeInit(void);
+void storeStart(void);
+void storeClose(void);
+void storeRecord(DBRecord *DBRow);
+void storeWake(sink_t *sk);
+long storeBacklog(void);
+bool storePrimary(const char *name);
+unsigned long storeCount(void);
+evloop_t *sinkLoop(sink_t *sk);
+
+// Storage backends (see WDL_DBMgr.c) and the sinks that feed them
+// A batch is committed (DB_OK), or the backend is unavailable and the
+//   batch must be retried (DB_DOWN), or the backend will never take it,
+//   e.g. a statement error (DB_REJECTED)
+typedef enum {DB_OK, DB_DOWN, DB_REJECTED} dbresult_t;
+typedef void (*dbdone_cb)(void *arg, dbresult_t result);
+typedef struct {
+    const char *name;
+    bool (*init)(sink_t *sk);
+    bool (*prepare)(void);
+    void (*appendBatch)(DBRecord *rows, int n, dbdone_cb done, void *arg);
+    void (*flush)(void);
+    void (*close)(void);
+    void (*lastTimes)(void (*cb)(char *sensorID, char *date_time));
+} backend_t;
+extern backend_t sqliteBackend, mysqlBackend, fileBackend;
 
 // SQL processing procedures
-void appendToDB(DBRecord *DBRow);
-void initDBMgr(void);
-#ifdef USE_SQLITE3
+backend_t *backendFind(char *name);
+char *backendNames(void);
+void dbLastTimes(void (*cb)(char *sensorID, char *date_time));
+void setBackend(char *optarg);
 void setSql3file(char *optarg);
 void setSql3path(char *optarg);
-#else
 void setMyHost(char *optarg);
 void setMyUser(char *optarg);
 void setMyPass(char *optarg);
-#endif
+void setDataFile(char *optarg);
+
+// Sharing the feed among several instances (MQTT v5 shared subscriptions)
+struct mosquitto;
+struct mosquitto_message;
+void setShareGroup(char *optarg);
+void setInstance(char *optarg);
+bool shareActive(void);
+void shareOpen(struct mosquitto *mosq);
+char *shareFilter(char *filter);
+bool shareConnected(struct mosquitto *mosq);
+bool shareMessage(const struct mosquitto_message *message);
+bool shareMine(char *sensorID, char *payload);
+void shareClose(struct mosquitto *mosq);
+
+// Raw capture log; each segment is a series of capBlocks, each followed
+//   by its zlib-compressed packets, with a capIndex entry for each block
+typedef struct {
+    uint32_t magic;
+    uint32_t rawLen;              // bytes of packets, uncompressed
+    uint32_t zLen;                // bytes of compressed data that follow
+    uint32_t count;               // packets in the block
+    uint32_t crc;                 // crc32 of the uncompressed packets
+    uint32_t pad;
+    int64_t  first, last;         // receive times of first and last packet, msec
+} capBlock;
+typedef struct {
+    int64_t  first, last;         // as in the block's capBlock
+    uint64_t offset;              // of the capBlock in the segment
+} capIndex;
+void setCaptureDir(char *optarg);
+void setCaptureKeep(char *optarg);
+void captureOpen(void);
+void captureClose(void);
+void captureRaw(char *payload);
+
+// Bulk import of historical packets
+void setImport(void);
+void importFiles(int n, char **paths);
+
+// Republishing of accepted readings to MQTT
+void setPubTopic(char *optarg);
+void publishInit(void);
+void publishRecord(DBRecord *DBRow);
+
+// Chart-data service for WWW_433
+void setHttp(char *optarg);
+void httpOpen(void);
+void httpClose(void);
+void httpRecord(DBRecord *DBRow);
+
+// "Latest readings" table in shared memory (layout in WDL_latest.h)
+void setLatest(char *optarg);
+void latestOpen(void);
+void latestRecord(DBRecord *DBRow);
+void latestClose(void);
+
+// Materialized chart views, kept up to date as records are committed
+void setViewDir(char *optarg);
+void setView(char *name, char *request);
+void viewOpen(void);
+void viewRecord(DBRecord *DBRow);
+void viewFlush(void);
+void viewClose(void);
 
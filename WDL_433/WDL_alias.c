@@ -0,0 +1,237 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_alias.c
+    Pattern aliases for WDL_433, weather data logger for rtl_433
+
+    An entry in the [aliases] section of WDL_433.ini gives the name a
+    sensor is recorded under, by its 'model'/'id'/'channel' sensorID.
+    A sensor's id changes when its battery is changed, so an entry may
+    instead be a pattern: '*' matches any text and '?' any char, within
+    one part of the sensorID, and a part 'lo..hi' any id from lo to hi:
+        [aliases]
+        Acurite-609TXC/0..255/   = Deck
+        Acurite-Tower/????/A     = Neighbor
+    A sensorID's own entry takes precedence over the patterns, and of
+    the patterns that match it, the first in the file.
+
+    The patterns are compiled into a trie, whose nodes are the chars of
+    the patterns ('*', '?' and a range being nodes too), each with the
+    first of the patterns at or below it, so a sensorID is matched by
+    one walk of the trie that leaves out any branch that can't improve
+    on the match already found.  A sensorID is matched when it's first
+    seen (node_new()) and its alias kept in its node of the sensor
+    registry, so however many patterns there are, they cost nothing
+    per packet.  When the .ini file is reloaded (SIGHUP), the patterns
+    are compiled again and every sensor's alias matched again.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "WDL_433.h"
+
+#define ALIAS_RANGE '\001'          // a trie node for a 'lo..hi' part
+
+typedef struct anode {
+    char          ch;               // a char, '*', '?' or ALIAS_RANGE
+    long          lo, hi;           // the range of ALIAS_RANGE
+    int           first;            // the pattern that ends here; INT_MAX if none
+    int           best;             // the first pattern at or below here
+    char         *alias;
+    struct anode *child, *next;
+} anode_t;
+
+// A set of patterns, compiled
+typedef struct {
+    anode_t root;
+    char  **patterns;               // in the order given, for aliasPrint()
+    char  **aliases;
+    int     npatterns;
+} aliasset_t;
+
+// The patterns in force, and those being read from the .ini file, put
+//   in force by aliasInit()
+static aliasset_t *active = NULL, *building = NULL;
+
+// Is the part of 'len' chars at 's' an id range, 'lo..hi'?
+static bool partRange(const char *s, size_t len, long *lo, long *hi) {
+    const char *dots = strstr(s, "..");
+    char       *end;
+    if ( (dots == NULL) || (dots >= s + len) || !isdigit((uint8_t)*s)
+         || !isdigit((uint8_t)dots[2]) ) return false;
+    *lo = strtol(s, &end, 10);
+    if (end != dots) return false;
+    *hi = strtol(dots + 2, &end, 10);
+    return (end == s + len) && (*lo <= *hi);
+};
+
+// Is the [aliases] key 'key' a pattern, rather than a sensorID?
+bool aliasPattern(char *key) {
+    long lo, hi;
+    if (strpbrk(key, "*?") != NULL) return true;
+    for (char *s = key; ; s++) {
+        if (partRange(s, strcspn(s, "/"), &lo, &hi)) return true;
+        if ( (s = strchr(s, '/')) == NULL ) return false;
+    };
+};
+
+// Add the [aliases] entry 'pattern = alias' to the trie being built
+void setAliasPattern(char *pattern, char *alias) {
+    aliasset_t *as;
+    anode_t    *n, *c;
+    char       *s = pattern, ch;
+    long        lo, hi;
+    size_t      len;
+    int         first;
+
+    if ( (building == NULL) && ((building = calloc(1, sizeof(aliasset_t))) != NULL) )
+        building->root.first = building->root.best = INT_MAX;
+    if ( ((as = building) == NULL)
+         || ((as->patterns = realloc(as->patterns, (as->npatterns+1)*sizeof(char *))) == NULL)
+         || ((as->aliases = realloc(as->aliases, (as->npatterns+1)*sizeof(char *))) == NULL) ) {
+        fprintf(stderr, "?WDL_433: out of memory for [aliases] patterns\n");
+        exit(EXIT_FAILURE);
+    };
+    n     = &as->root;
+    first = as->npatterns++;
+    as->patterns[first] = strdup(pattern);
+    as->aliases[first]  = strdup(alias);
+    while (*s != '\0') {
+        if (n->best == INT_MAX) n->best = first;
+        lo = hi = 0;
+        len = strcspn(s, "/");
+        if ( ((s == pattern) || (s[-1] == '/')) && partRange(s, len, &lo, &hi) ) {
+            ch = ALIAS_RANGE;
+            s += len;
+        } else ch = *s++;
+        for (c = n->child; c != NULL; c = c->next)
+            if ( (c->ch == ch) && (c->lo == lo) && (c->hi == hi) ) break;
+        if (c == NULL) {
+            if ( (c = calloc(1, sizeof(anode_t))) == NULL ) {
+                fprintf(stderr, "?WDL_433: out of memory for [aliases] patterns\n");
+                exit(EXIT_FAILURE);
+            };
+            c->ch    = ch;
+            c->lo    = lo;
+            c->hi    = hi;
+            c->first = c->best = INT_MAX;
+            c->next  = n->child;
+            n->child = c;
+        };
+        n = c;
+    };
+    if (n->best == INT_MAX) n->best = first;
+    // Of two entries for the same pattern, the first is taken
+    if (n->first == INT_MAX) {
+        n->first = first;
+        n->alias = as->aliases[first];
+    };
+};
+
+// Match the rest of a sensorID, 's', against the trie below 'n', keeping
+//   the first pattern matched in '*found'
+static void aliasWalk(anode_t *n, const char *s, anode_t **found) {
+    const char *t;
+    size_t      len;
+    long        id;
+
+    if ( (*found != NULL) && (n->best >= (*found)->first) ) return;
+    if ( (*s == '\0') && (n->first != INT_MAX)
+         && ((*found == NULL) || (n->first < (*found)->first)) ) *found = n;
+    for (anode_t *c = n->child; c != NULL; c = c->next)
+        switch (c->ch) {
+        case '*':
+            for (t = s; ; t++) {
+                aliasWalk(c, t, found);
+                if ( (*t == '\0') || (*t == '/') ) break;
+            };
+            break;
+        case '?':
+            if ( (*s != '\0') && (*s != '/') ) aliasWalk(c, s+1, found);
+            break;
+        case ALIAS_RANGE:
+            len = strcspn(s, "/");
+            if ( (len == 0) || (strspn(s, "0123456789") != len) ) break;
+            id = strtol(s, NULL, 10);
+            if ( (id >= c->lo) && (id <= c->hi) ) aliasWalk(c, s+len, found);
+            break;
+        default:
+            if (*s == c->ch) aliasWalk(c, s+1, found);
+        };
+};
+
+// A copy of the alias given by the first pattern 'sensorID' matches, or NULL
+char *aliasMatch(char *sensorID) {
+    anode_t *found = NULL;
+    if ( (active == NULL) || (active->npatterns == 0) ) return NULL;
+    aliasWalk(&active->root, sensorID, &found);
+    if (found == NULL) return NULL;
+    LOG(LM_MAIN, LV_DEBUG, "sensorID %s aliased as '%s' by pattern '%s'\n",
+        sensorID, found->alias, active->patterns[found->first]);
+    return strdup(found->alias);
+};
+
+// Is 'alias' given by any of the patterns?
+bool aliasByPattern(const char *alias) {
+    for (int i = 0; (active != NULL) && (i < active->npatterns); i++)
+        if (strcmp(active->aliases[i], alias) == 0) return true;
+    return false;
+};
+
+static void trieFree(anode_t *n) {
+    anode_t *c, *next;
+    for (c = n->child; c != NULL; c = next) {
+        next = c->next;
+        trieFree(c);
+        free(c);
+    };
+};
+
+static void aliasFree(aliasset_t *as) {
+    if (as == NULL) return;
+    trieFree(&as->root);
+    for (int i = 0; i < as->npatterns; i++) {
+        free(as->patterns[i]);
+        free(as->aliases[i]);
+    };
+    free(as->patterns);
+    free(as->aliases);
+    free(as);
+};
+
+// Put the patterns read from the .ini file in force, in place of those
+//   in force (if it's being reloaded).  Sensors keep copies of their
+//   aliases, so the patterns replaced are freed at once
+void aliasInit(void) {
+    aliasset_t *old = active;
+    active   = building;
+    building = NULL;
+    aliasFree(old);
+};
+
+// Drop the patterns read so far, if the .ini file they're in can't be used
+void aliasAbort(void) {
+    aliasFree(building);
+    building = NULL;
+};
+
+// Give each sensor in the tree at 'p' the alias the patterns in force give it
+void aliasApply(NPTR p) {
+    if (p == NULL) return;
+    aliasApply(p->lptr);
+    free(p->alias);
+    p->alias = aliasMatch(p->key);
+    aliasApply(p->rptr);
+};
+
+void aliasPrint(void) {
+    if (active == NULL) return;
+    for (int i = 0; i < active->npatterns; i++)
+        printf("\tpattern  %-20s aliased as '%s'\n", active->patterns[i], active->aliases[i]);
+};
@@ -0,0 +1,272 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_capture.c
+    Raw capture log for WDL_433, weather data logger for rtl_433
+
+    WDL_433 records one reading per sensor per 'recordingInterval' and
+    only the fields in json_rtl[].  If 'capturedir' is set, every
+    packet that passes the TPMS/temperature prefilter is also appended,
+    as received, to a capture log in that directory (in a 'share' group,
+    by the instance the packet's sensor belongs to), so new fields can
+    be derived or history reprocessed later (WDL_433 --import reads
+    capture segments as well as rtl_433 JSON logs).
+
+    The log is a series of segments, each a pair of files named for
+    the time the segment was started:
+        capture-YYYYmmdd-HHMMSS.wcap    compressed blocks
+        capture-YYYYmmdd-HHMMSS.widx    one capIndex per block
+    Packets are collected, each as a line "<receive time, msec>\t<JSON>",
+    into blocks of up to CAP_BLOCK bytes; each block is compressed with
+    zlib and appended to the segment after a capBlock header, then its
+    time range and offset are appended to the index, so a time range
+    can be found without reading the segments.  A block is written
+    when it's full or has waited CAP_FLUSH sec.  A new segment is
+    started when the current one reaches CAP_SEGMENT bytes or is a day
+    old.
+
+    'capturekeep' limits the log by age, size, or both, e.g. '30d',
+    '2G' or '30d,2G' (units: h, d; K, M, G); the oldest segments are
+    deleted when a new segment is started.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "WDL_433.h"
+
+extern char *captureDir;
+extern char *captureKeep;
+
+static char   *block = NULL;      // packets waiting to be compressed
+static size_t  blockLen = 0;
+static int     blockCount = 0;
+static int64_t blockFirst, blockLast;
+static Bytef  *zbuf = NULL;
+static uLong   zmax;
+static int     segFd = -1, idxFd = -1;
+static off_t   segSize;
+static time_t  segStarted;
+static char    segName[32];       // name of the current segment, without extension
+static time_t  keepAge  = 0;      // sec; 0 = no limit
+static off_t   keepSize = 0;      // bytes; 0 = no limit
+
+static int64_t nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+};
+
+// Parse 'capturekeep': comma-separated limits such as '30d' and '2G'
+static void captureLimits(void) {
+    char *list, *item, *save, *end;
+    double v;
+    if ( (captureKeep == NULL) || (*captureKeep == '\0') ) return;
+    list = strdup(captureKeep);
+    for (item = strtok_r(list, ", \t", &save); item != NULL; item = strtok_r(NULL, ", \t", &save)) {
+        v = strtod(item, &end);
+        if ( (end == item) || (v <= 0) || (end[0] == '\0') || (end[1] != '\0') ) end = "?";
+        switch (*end) {
+        case 'h': case 'H': keepAge  = v*3600;          break;
+        case 'd': case 'D': keepAge  = v*86400;         break;
+        case 'k': case 'K': keepSize = v*1024;          break;
+        case 'm': case 'M': keepSize = v*1024*1024;     break;
+        case 'g': case 'G': keepSize = v*1024*1024*1024; break;
+        default:
+            fprintf(stderr, "?WDL_433: invalid capturekeep '%s': use e.g. '30d', '2G' or '30d,2G'\n",
+                    item);
+            exit(EXIT_FAILURE);
+        };
+    };
+    free(list);
+};
+
+static int segCompare(const void *a, const void *b) {
+    return strcmp(*(char **)a, *(char **)b);
+};
+
+// Delete the oldest segments beyond the age and size limits
+static void captureExpire(void) {
+    DIR    *d;
+    struct dirent *de;
+    struct stat st;
+    char  **names = NULL, path[PATH_MAX];
+    off_t  *sizes = NULL, total = 0;
+    time_t *times = NULL, now = time(NULL);
+    int     n = 0, len;
+
+    if ( (keepAge == 0) && (keepSize == 0) ) return;
+    if ( (d = opendir(captureDir)) == NULL ) return;
+    while ( (de = readdir(d)) != NULL ) {
+        len = strlen(de->d_name);
+        if ( (strncmp(de->d_name, "capture-", 8) != 0) || (len < 5)
+             || (strcmp(de->d_name + len - 5, ".wcap") != 0) ) continue;
+        names = realloc(names, (n+1)*sizeof(char *));
+        names[n++] = strdup(de->d_name);
+    };
+    closedir(d);
+    qsort(names, n, sizeof(char *), segCompare);      // oldest first
+    sizes = calloc(n+1, sizeof(off_t));
+    times = calloc(n+1, sizeof(time_t));
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/%s", captureDir, names[i]);
+        if (stat(path, &st) == 0) {
+            sizes[i] = st.st_size;
+            times[i] = st.st_mtime;
+            total   += st.st_size;
+        };
+    };
+    for (int i = 0; i < n; i++) {
+        bool old = (keepAge > 0) && (now - times[i] > keepAge);
+        bool big = (keepSize > 0) && (total > keepSize);
+        if ( (!old && !big) || (strncmp(names[i], segName, strlen(segName)) == 0) ) break;
+        snprintf(path, sizeof(path), "%s/%s", captureDir, names[i]);
+        unlink(path);
+        strcpy(path + strlen(path) - 5, ".widx");
+        unlink(path);
+        total -= sizes[i];
+        LOG(LM_MAIN, LV_DEBUG, "Capture segment %s deleted\n", names[i]);
+    };
+    for (int i = 0; i < n; i++) free(names[i]);
+    free(names);
+    free(sizes);
+    free(times);
+};
+
+static void captureEndSegment(void) {
+    if (segFd >= 0) close(segFd);
+    if (idxFd >= 0) close(idxFd);
+    segFd = idxFd = -1;
+};
+
+// Start a new segment; false if it can't be created
+static bool captureNewSegment(void) {
+    char path[PATH_MAX];
+    struct tm tm;
+    captureEndSegment();
+    segStarted = time(NULL);
+    localtime_r(&segStarted, &tm);
+    strftime(segName, sizeof(segName), "capture-%Y%m%d-%H%M%S", &tm);
+    snprintf(path, sizeof(path), "%s/%s.wcap", captureDir, segName);
+    segFd = open(path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    snprintf(path, sizeof(path), "%s/%s.widx", captureDir, segName);
+    idxFd = open(path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    if ( (segFd < 0) || (idxFd < 0) ) {
+        LOG(LM_MAIN, LV_ERR, "Can't create capture segment '%s': %s\n", path, strerror(errno));
+        captureEndSegment();
+        return false;
+    };
+    segSize = lseek(segFd, 0, SEEK_END);
+    captureExpire();
+    return true;
+};
+
+// Compress the packets collected and append them to the segment
+static void captureFlush(void) {
+    capBlock hdr;
+    capIndex idx;
+    uLong    zlen = zmax;
+
+    if (blockCount == 0) return;
+    if ( (segFd < 0) || (segSize >= CAP_SEGMENT) || (time(NULL) - segStarted >= 86400) )
+        if (!captureNewSegment()) goto drop;
+    if (compress2(zbuf, &zlen, (Bytef *)block, blockLen, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        LOG(LM_MAIN, LV_ERR, "Can't compress capture block\n");
+        goto drop;
+    };
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic  = CAP_MAGIC;
+    hdr.rawLen = blockLen;
+    hdr.zLen   = zlen;
+    hdr.count  = blockCount;
+    hdr.crc    = crc32(0, (Bytef *)block, blockLen);
+    hdr.first  = blockFirst;
+    hdr.last   = blockLast;
+    idx.first  = blockFirst;
+    idx.last   = blockLast;
+    idx.offset = segSize;
+    if ( (write(segFd, &hdr, sizeof(hdr)) != sizeof(hdr))
+         || (write(segFd, zbuf, zlen) != (ssize_t)zlen) ) {
+        LOG(LM_MAIN, LV_ERR, "Can't write capture segment %s: %s\n", segName, strerror(errno));
+        // Drop what was written of the block so the segment stays readable
+        if (ftruncate(segFd, segSize) != 0) {};
+        goto drop;
+    };
+    if (write(idxFd, &idx, sizeof(idx)) != sizeof(idx))
+        LOG(LM_MAIN, LV_WARN, "Can't write capture index %s: %s\n", segName, strerror(errno));
+    fdatasync(segFd);
+    segSize += sizeof(hdr) + zlen;
+drop:
+    blockLen = 0;
+    blockCount = 0;
+};
+
+static void captureTimer(void *arg) {
+    if ( (blockCount > 0) && (nowMs() - blockFirst >= CAP_FLUSH*1000L) ) captureFlush();
+};
+
+// Append a packet that passed the prefilter to the capture log
+void captureRaw(char *payload) {
+    char    stamp[24];
+    int64_t now;
+    size_t  len, slen;
+
+    if (block == NULL) return;
+    now  = nowMs();
+    slen = snprintf(stamp, sizeof(stamp), "%lld\t", (long long)now);
+    len  = strlen(payload);
+    while ( (len > 0) && ((payload[len-1] == '\n') || (payload[len-1] == '\r')) ) len--;
+    if (slen + len + 1 > CAP_BLOCK) return;        // can't be a packet from rtl_433
+    if (blockLen + slen + len + 1 > CAP_BLOCK) captureFlush();
+    if (blockCount == 0) blockFirst = now;
+    blockLast = now;
+    memcpy(block + blockLen, stamp, slen);
+    memcpy(block + blockLen + slen, payload, len);
+    blockLen += slen + len;
+    block[blockLen++] = '\n';
+    blockCount++;
+};
+
+void captureOpen(void) {
+    struct stat st;
+    if ( (captureDir == NULL) || (*captureDir == '\0') ) return;
+    captureLimits();
+    if ( (stat(captureDir, &st) != 0) || !S_ISDIR(st.st_mode) ) {
+        fprintf(stderr, "?WDL_433: capture directory '%s' doesn't exist\n", captureDir);
+        exit(EXIT_FAILURE);
+    };
+    zmax  = compressBound(CAP_BLOCK);
+    block = malloc(CAP_BLOCK);
+    zbuf  = malloc(zmax);
+    if ( (block == NULL) || (zbuf == NULL) ) {
+        fprintf(stderr, "?WDL_433: out of memory for capture log\n");
+        exit(EXIT_FAILURE);
+    };
+    if (!captureNewSegment()) {
+        fprintf(stderr, "?WDL_433: can't write capture log in '%s'\n", captureDir);
+        exit(EXIT_FAILURE);
+    };
+    evTimer(mainLoop, 1000, true, captureTimer, NULL);
+    LOG(LM_MAIN, LV_DEBUG, "Capturing packets to '%s/%s.wcap'\n", captureDir, segName);
+};
+
+void captureClose(void) {
+    if (block == NULL) return;
+    captureFlush();
+    captureEndSegment();
+    free(block);
+    free(zbuf);
+    block = NULL;
+    zbuf  = NULL;
+};
@@ -0,0 +1,295 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_chart.c
+    Chart requests for WDL_433, weather data logger for rtl_433
+
+    A chart is asked for by a request such as
+        series=Deck:temp1,Deck:rh&hours=24&bin=5m&points=900
+    whether from the chart-data service (WDL_http.c, where the request
+    is described) or as a view (WDL_views.c), and both answer it with
+    the same JSON, written here.  'bin' is in sec, or with s, m or h.
+    With 'bin', a rolling range of 'hours' starts with the first of the
+    bins that cover it, so a chart and a view of the same request have
+    the same bins.
+
+    Downsampling is Largest-Triangle-Three-Buckets, done as the rows
+    are written: the range is cut into 'points' buckets of equal time,
+    and from each bucket, for each series, the row is kept that makes
+    the largest triangle with the row last kept for the series and the
+    mean of the series in the next bucket.  The first and last rows are
+    always kept, and a row kept for any series is written with all its
+    values.  Only two buckets' rows are held at a time, so the reply's
+    size depends on 'points', not on the range.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+
+#include "WDL_433.h"
+#include "WDL_chart.h"
+
+void bufAdd(hbuf_t *b, const char *fmt, ...) {
+    va_list ap;
+    int     n;
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(b->s + b->len, b->max - b->len, fmt, ap);
+        va_end(ap);
+        if (b->len + n < b->max) break;
+        b->max = 2*(b->len + n + 1);
+        if ( (b->s = realloc(b->s, b->max)) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for chart data\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    b->len += n;
+};
+
+// A string in JSON, without its quotes: '"', '\' and control characters escaped
+static void bufEscaped(hbuf_t *b, const char *s) {
+    for (; *s != '\0'; s++)
+        if ( (*s == '"') || (*s == '\\') )  bufAdd(b, "\\%c", *s);
+        else if ((unsigned char)*s < ' ')   bufAdd(b, "\\u%04x", *s);
+        else                                bufAdd(b, "%c", *s);
+};
+
+// A string as JSON
+void bufString(hbuf_t *b, const char *s) {
+    bufAdd(b, "\"");
+    bufEscaped(b, s);
+    bufAdd(b, "\"");
+};
+
+// Seconds since 1970 of 'YYYY-mm-dd HH:MM:SS', or any leading part of
+//   it, taken as UTC (for binning)
+int64_t dtSeconds(const char *s) {
+    int y = 1970, m = 1, d = 1, H = 0, M = 0, S = 0;
+    sscanf(s, "%d-%d-%d %d:%d:%d", &y, &m, &d, &H, &M, &S);
+    y -= (m <= 2);
+    int64_t era = (y >= 0 ? y : y-399) / 400;
+    int64_t yoe = y - era*400;
+    int64_t doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d - 1;
+    int64_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return (era*146097 + doe - 719468)*86400 + H*3600 + M*60 + S;
+};
+
+// Decode a %-encoded query value in place
+void urlDecode(char *s) {
+    char *d = s;
+    int   c;
+    for (; *s != '\0'; s++, d++) {
+        if (*s == '+') *d = ' ';
+        else if ( (*s == '%') && (sscanf(s+1, "%2x", &c) == 1) ) {
+            *d = c;
+            s += 2;
+        } else *d = *s;
+    };
+    *d = '\0';
+};
+
+// Parse the chart request 'query' into 'q'; keys it doesn't know are ignored
+const char *chartParse(char *query, chartreq_t *q) {
+    char  *key, *val, *end, *save, *item, *colon, *list = NULL;
+    double bin;
+    long   n;
+    int    f;
+
+    memset(q, 0, sizeof(chartreq_t));
+    q->hours = CHART_HOURS;
+    q->since = -1;
+    for (key = strtok_r(query, "&", &save); key != NULL; key = strtok_r(NULL, "&", &save)) {
+        if ( (val = strchr(key, '=')) == NULL ) continue;
+        *val++ = '\0';
+        urlDecode(val);
+        if (strcmp(key, "series") == 0) list = val;
+        else if (strcmp(key, "hours") == 0) {
+            if ( ((q->hours = strtol(val, &end, 10)) <= 0) || (end == val) || (*end != '\0') )
+                return "invalid 'hours'";
+        } else if (strcmp(key, "bin") == 0) {
+            bin = strtod(val, &end);
+            if      ( (*end == 'm') || (*end == 'M') ) bin *= 60;
+            else if ( (*end == 'h') || (*end == 'H') ) bin *= 3600;
+            else if ( (*end != '\0') && (*end != 's') && (*end != 'S') ) return "invalid 'bin'";
+            if ( (end == val) || ((*end != '\0') && (end[1] != '\0')) || (bin < 0)
+                 || (bin > 366*86400) || (bin != (int)bin) ) return "invalid 'bin'";
+            q->bin = (int)bin;
+        } else if (strcmp(key, "points") == 0) {
+            if ( ((n = strtol(val, &end, 10)) < 0) || (n > CHART_POINTS) || (end == val)
+                 || (*end != '\0') ) return "invalid 'points'";
+            q->points = n;
+        } else if (strcmp(key, "from") == 0)
+            snprintf(q->from, sizeof(q->from), "%s", val);
+        else if (strcmp(key, "to") == 0)
+            snprintf(q->to, sizeof(q->to), "%s", val);
+        else if (strcmp(key, "since") == 0) {
+            if ( (*val == '\0') || !isnumeric(val) ) return "invalid 'since'";
+            q->since = atoll(val);
+        };
+    };
+    if (list == NULL) return "no 'series'";
+    for (item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if (q->nseries == CHART_SERIES) return "too many series";
+        if ( ((colon = strrchr(item, ':')) == NULL) || (colon == item) )
+            return "a series isn't <sensor>:<field>";
+        *colon++ = '\0';
+        for (f = 0; f < AGG_FIELDS; f++)
+            if (strcmp(colon, aggFields[f]) == 0) break;
+        if (f == AGG_FIELDS) return "a series' field isn't temp1, temp2, rh, press or light";
+        q->sensor[q->nseries] = item;
+        q->field[q->nseries]  = f;
+        q->nseries++;
+    };
+    if (q->nseries == 0) return "no 'series'";
+    return NULL;
+};
+
+int64_t chartNow(void) {
+    char      now[24];
+    time_t    t = time(NULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(now, sizeof(now), "%Y-%m-%d %H:%M:%S", &tm);
+    return dtSeconds(now);
+};
+
+int chartBins(chartreq_t *q) {
+    return (q->hours*3600 + q->bin - 1)/q->bin;
+};
+
+int64_t chartStart(chartreq_t *q, int64_t now) {
+    if (q->bin == 0) return now - q->hours*3600;
+    return (now/q->bin - chartBins(q) + 1)*q->bin;
+};
+
+void chartLabel(int64_t t, char label[24]) {
+    time_t    tt = t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    strftime(label, 24, "%Y-%m-%d %H:%M:%S", &tm);
+};
+
+// Write the row 'r' of chart 'ch'
+static void chartWrite(chart_t *ch, hrow_t *r) {
+    bufAdd(ch->b, "%s[\"%s\"", (ch->written++ == 0) ? "" : ",", r->label);
+    for (int s = 0; s < ch->q->nseries; s++)
+        if (r->has[s]) bufAdd(ch->b, ",%.*f", aggDigits[ch->q->field[s]], r->v[s]);
+        else           bufAdd(ch->b, ",null");
+    bufAdd(ch->b, "]");
+};
+
+// Keep, for each series, the row of bucket 'from' that makes the
+//   largest triangle with the row last kept and the series' mean in
+//   bucket 'next' (or, for the last bucket, its last row); then write
+//   the rows kept
+static void chartChoose(chart_t *ch, bucket_t *from, bucket_t *next) {
+    for (int s = 0; s < ch->q->nseries; s++) {
+        double cx = 0, cy = 0, area, best = -1;
+        int    n = 0, keep = -1;
+        for (int i = 0; (next != NULL) && (i < next->n); i++)
+            if (next->row[i].has[s]) {
+                cx += next->row[i].t;
+                cy += next->row[i].v[s];
+                n++;
+            };
+        if (n > 0) {
+            cx /= n;
+            cy /= n;
+        };
+        for (int i = 0; i < from->n; i++) {
+            hrow_t *r = &from->row[i];
+            if (!r->has[s]) continue;
+            if (!ch->haveA[s]) {            // the series' first row
+                keep = i;
+                break;
+            };
+            if (n == 0) {                   // the last bucket
+                keep = i;
+                continue;
+            };
+            area = fabs((ch->ax[s] - cx)*(r->v[s] - ch->ay[s]) - (ch->ax[s] - r->t)*(cy - ch->ay[s]));
+            if (area > best) {
+                best = area;
+                keep = i;
+            };
+        };
+        if (keep < 0) continue;
+        from->row[keep].keep = true;
+        ch->haveA[s] = true;
+        ch->ax[s]    = from->row[keep].t;
+        ch->ay[s]    = from->row[keep].v[s];
+    };
+    for (int i = 0; i < from->n; i++)
+        if (from->row[i].keep) chartWrite(ch, &from->row[i]);
+    from->n = 0;
+};
+
+void chartBegin(chart_t *ch, hbuf_t *b, chartreq_t *q, int64_t start, int64_t end) {
+    memset(ch, 0, sizeof(chart_t));
+    ch->b     = b;
+    ch->q     = q;
+    ch->start = start;
+    ch->width = (q->points > 0) ? (end - start)/q->points : 0;
+    if (ch->width < 1) ch->width = 1;
+    bufAdd(b, "{\"columns\":[\"date_time\"");
+    for (int s = 0; s < q->nseries; s++) {
+        bufAdd(b, ",\"");
+        bufEscaped(b, q->sensor[s]);
+        bufAdd(b, ":%s\"", aggFields[q->field[s]]);
+    };
+    bufAdd(b, "],\"rows\":[");
+};
+
+// Add the row 'r' to chart 'ch': write it, or downsample
+void chartRow(chart_t *ch, hrow_t *r) {
+    int64_t k;
+    if (ch->q->points == 0) {
+        chartWrite(ch, r);
+        return;
+    };
+    r->t -= ch->start;
+    k = (r->t > 0) ? r->t/ch->width : 0;
+    if ( (ch->cur.n > 0) && (k != ch->bucket) ) {
+        if (ch->prev.n > 0) chartChoose(ch, &ch->prev, &ch->cur);
+        bucket_t t = ch->prev;
+        ch->prev = ch->cur;
+        ch->cur  = t;
+    };
+    ch->bucket = k;
+    if (ch->cur.n == ch->cur.max) {
+        ch->cur.max = (ch->cur.max == 0) ? 64 : 2*ch->cur.max;
+        if ( (ch->cur.row = realloc(ch->cur.row, ch->cur.max*sizeof(hrow_t))) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for chart data\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    r->keep = false;
+    ch->cur.row[ch->cur.n++] = *r;
+};
+
+// Write the rows still held by the downsampling, and "last"
+void chartEnd(chart_t *ch, const char *latest, long long since) {
+    struct tm tm;
+    if (ch->prev.n > 0) chartChoose(ch, &ch->prev, &ch->cur);
+    if (ch->cur.n > 0) {
+        ch->cur.row[ch->cur.n-1].keep = true;
+        chartChoose(ch, &ch->cur, NULL);
+    };
+    free(ch->prev.row);
+    free(ch->cur.row);
+    if ( (ch->written > 0) && (latest != NULL) && (latest[0] != '\0') ) {
+        memset(&tm, 0, sizeof(tm));
+        strptime(latest, "%Y-%m-%d %H:%M:%S", &tm);
+        tm.tm_isdst = -1;
+        since = mktime(&tm);
+    };
+    if (since >= 0) bufAdd(ch->b, "],\"last\":%lld}\n", since);
+    else            bufAdd(ch->b, "],\"last\":null}\n");
+};
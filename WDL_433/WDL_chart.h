@@ -0,0 +1,95 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*
+    WDL_chart.h
+    Definitions for the chart requests of WDL_433, answered by the
+    chart-data service (WDL_http.c) and kept as views (WDL_views.c)
+
+    Both take the same request, e.g. 'series=Deck:temp1&hours=24&bin=5m',
+    parsed by chartParse(), and write the same JSON reply through the
+    chart writer, chartBegin(), chartRow() and chartEnd().
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CHART_SERIES  8           // most series in one chart
+#define CHART_HOURS   240         // default range of a chart
+#define CHART_POINTS  10000       // most points per series when downsampling
+
+// A growing buffer of text
+typedef struct {
+    char   *s;
+    size_t  len, max;
+} hbuf_t;
+
+void bufAdd(hbuf_t *b, const char *fmt, ...);
+void bufString(hbuf_t *b, const char *s);
+
+// A chart request, parsed; the sensor names point into the request
+typedef struct {
+    char     *sensor[CHART_SERIES];
+    int       field[CHART_SERIES];    // index in aggFields[]
+    int       nseries;
+    long      hours;
+    int       bin;                    // sec, or 0 for a row per reading
+    int       points;                 // downsample to about this many, if > 0
+    char      from[24], to[24];       // "" if not given
+    long long since;                  // -1 if not given
+} chartreq_t;
+
+// Parse 'query', decoding it in place; returns NULL, or what's wrong with it
+const char *chartParse(char *query, chartreq_t *q);
+void urlDecode(char *s);
+
+// Seconds since 1970 of 'YYYY-mm-dd HH:MM:SS', taken as UTC (for binning)
+int64_t dtSeconds(const char *s);
+
+// Now, in sec from 1970, on the local clock the database records
+int64_t chartNow(void);
+// The bins of 'bin' sec that cover 'hours', and the start of the first
+//   of them, for a range that ends at 'now'; without 'bin', 'hours' ago
+int     chartBins(chartreq_t *q);
+int64_t chartStart(chartreq_t *q, int64_t now);
+// 'YYYY-mm-dd HH:MM:SS' of 't', in sec from 1970 (as from dtSeconds())
+void    chartLabel(int64_t t, char label[24]);
+
+// One output row of a chart
+typedef struct {
+    int64_t t;                        // sec from 1970, as from dtSeconds()
+    char    label[24];
+    bool    has[CHART_SERIES];        // the series has a value in the row
+    double  v[CHART_SERIES];
+    bool    keep;                     // kept by the downsampling
+} hrow_t;
+
+// The rows of one downsampling bucket
+typedef struct {
+    hrow_t *row;
+    int     n, max;
+} bucket_t;
+
+// The rows of a chart on their way to the reply
+typedef struct {
+    hbuf_t     *b;
+    chartreq_t *q;
+    int         written;              // rows written
+    int64_t     start;                // of the range, sec from 1970
+    int64_t     width;                // sec per bucket
+    int64_t     bucket;               // number of bucket 'cur'
+    bucket_t    prev, cur;            // the bucket to choose from, and the next
+    bool        haveA[CHART_SERIES];  // the row last kept for each series
+    double      ax[CHART_SERIES], ay[CHART_SERIES];
+} chart_t;
+
+// Write the reply to 'q', for the range 'start' to 'end', into 'b': its
+//   columns, then each row given to chartRow(), in time order, then
+//   "last", the time of 'latest' ('YYYY-mm-dd HH:MM:SS', the latest
+//   reading in the rows) or, if there are no rows, 'since' (if >= 0)
+void chartBegin(chart_t *ch, hbuf_t *b, chartreq_t *q, int64_t start, int64_t end);
+void chartRow(chart_t *ch, hrow_t *r);
+void chartEnd(chart_t *ch, const char *latest, long long since);
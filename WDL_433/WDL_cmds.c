@@ -23,15 +23,33 @@
     Gdebug                x       x
     help                          x
     config                        x
-    source                x       x     x    //disabled for now
-    host         x        x       x
+    source                x       x     x
+    host         x        x       x          //MQTT server, or UDP address
     port         x        x       x     x
     topic        c        x       x     x
-    sql3path     c        x       x     x
-    sql3file     c        x       x     x
-    myhost       c        x       x
-    myuser       c        x       x
-    mypass       c        x       x
+    models                x       x     x    //MQTT models to subscribe to
+    nomodels              x       x     x    //  and not to
+    share                 x       x     x    //MQTT v5 shared-subscription group
+    instance              x       x     x    //  and this instance's name in it
+    pubtopic              x       x     x    //republish readings (MQTT)
+    aggregate             x       x     x    //record window means [and min/max]
+    http                  x       x     x    //serve chart data for WWW_433
+    viewdir               x       x     x    //  and write the [views] there
+    latest                x       x     x    //latest readings in shared memory
+    lagbudget             x       x     x
+    log                   x       x
+    import                        x          //load files of packets, then exit
+    statefile             x       x     x
+    spoolfile             x       x     x
+    capturedir            x       x     x    //raw capture log
+    capturekeep           x       x     x    //  and how much of it to keep
+    backend               x       x     x
+    sql3path              x       x     x    //used only by the backend
+    sql3file              x       x     x    //  that needs them
+    myhost                x       x
+    myuser                x       x
+    mypass                x       x
+    datafile              x       x     x
 */
 
 #include "WDL_433.h"
@@ -48,20 +66,35 @@
 static auxdata optdetails[] = {
     //ltr switches                 &setter function      desc  
     {'c', SWCLI,                   NULL,                 "Path/name for configuration file"},
-//  {'S', SWINI|SWCLI|SWSET,       (void *)&setSource,   "Source protocol [ MQTT | HTTP ]"},
+    {'S', SWINI|SWCLI|SWSET,       (void *)&setSource,   "Source protocol [ MQTT | UDP | STDIN ]"},
     {'H', SWRQD|SWINI|SWCLI,       (void *)&setHost,     "Name or IP of MQTT or HTTP host"},
     {'P', SWRQD|SWINI|SWCLI|SWSET, (void *)&setPort,     "Port number of MQTT or HTTP host"},
     {'T', SWRQD|SWINI|SWCLI,       (void *)&setTopic,    "MQTT publisher topic to monitor"},
-#ifdef USE_SQLITE3
-    {'q', SWRQD|SWINI|SWCLI|SWSET, (void *)&setSql3path, "Path to sqlite3 database file"},
-    {'s', SWRQD|SWINI|SWCLI|SWSET, (void *)&setSql3file, "Name of sqlite3 database file"},
-#else
-    {'m', SWRQD|SWINI|SWCLI,       (void *)&setMyHost,   "MySQL host Name or IP"},
-    {'u', SWRQD|SWINI|SWCLI,       (void *)&setMyUser,   "MySQL username"},
-    {'p', SWRQD|SWINI|SWCLI,       (void *)&setMyPass,   "MySQL password"},
-#endif
+    {'M', SWINI|SWCLI|SWSET,       (void *)&setModels,   "Models to receive, comma-separated (MQTT per-model topics)"},
+    {'N', SWINI|SWCLI|SWSET,       (void *)&setNoModels, "Models not to receive, comma-separated"},
+    {'g', SWINI|SWCLI|SWSET,       (void *)&setShareGroup, "Group of instances to share the MQTT feed with ('' = none)"},
+    {'i', SWINI|SWCLI|SWSET,       (void *)&setInstance, "Name of this instance in the group (default: host name)"},
+    {'R', SWINI|SWCLI|SWSET,       (void *)&setPubTopic, "MQTT topic prefix to republish readings to ('' = none)"},
+    {'A', SWINI|SWCLI|SWSET,       (void *)&setAggregate, "Record each window's [ off | mean | minmax ] of readings"},
+    {'W', SWINI|SWCLI|SWSET,       (void *)&setHttp,     "[Address:]port to serve chart data on ('' = none)"},
+    {'V', SWINI|SWCLI|SWSET,       (void *)&setViewDir,  "Directory to write the [views] charts to ('' = none)"},
+    {'O', SWINI|SWCLI|SWSET,       (void *)&setLatest,   "Shared memory for the latest readings, e.g. '/WDL_433' ('' = none)"},
+    {'L', SWINI|SWCLI|SWSET,       (void *)&setLagBudget, "Receive-to-commit lag budget, sec (0=none)"},
+    {'B', SWINI|SWCLI|SWSET,       (void *)&setBackend,  "Storage backend(s) [ sqlite3 | mysql | file | null ], comma-separated"},
+    {'q', SWINI|SWCLI|SWSET,       (void *)&setSql3path, "Path to sqlite3 database file"},
+    {'s', SWINI|SWCLI|SWSET,       (void *)&setSql3file, "Name of sqlite3 database file"},
+    {'m', SWINI|SWCLI,             (void *)&setMyHost,   "MySQL host Name or IP"},
+    {'u', SWINI|SWCLI,             (void *)&setMyUser,   "MySQL username"},
+    {'p', SWINI|SWCLI,             (void *)&setMyPass,   "MySQL password"},
+    {'F', SWINI|SWCLI|SWSET,       (void *)&setDataFile, "Data file for the 'file' backend"},
     {'D', SWINI|SWCLI,             (void *)&setDebug,    "Print WDL debugging information"},
     {'G', SWINI|SWCLI,             (void *)&setGDebug,   "Print GetSetParams() debugging information"},
+    {'w', SWINI|SWCLI|SWSET,       (void *)&setStateFile, "Sensor state file for warm restarts ('' = none)"},
+    {'Q', SWINI|SWCLI|SWSET,       (void *)&setSpoolFile, "Spool file for records the database can't take ('' = none)"},
+    {'C', SWINI|SWCLI|SWSET,       (void *)&setCaptureDir, "Directory for the raw capture log ('' = none)"},
+    {'K', SWINI|SWCLI|SWSET,       (void *)&setCaptureKeep, "Capture log to keep, e.g. '30d', '2G' ('' = all)"},
+    {'l', SWINI|SWCLI,             (void *)&setLog,      "Log levels, e.g. 'debug' or 'db=debug,fresh=warn'"},
+    {'I', SWCLI,                   (void *)&setImport,   "Import the packets in the files named, then exit"},
     {'h', SWCLI,                   (void *)&helper,      "This help message"},
     {'v', SWCLI,                   NULL,                 "Print program version number"},
     {0,   0,                       NULL,                  NULL}
@@ -74,29 +107,40 @@ static auxdata optdetails[] = {
 //  The indices for the 'long_opt' 'ltr' value and the 'optaux' 'val' value
 //  must be the same (validated by GetSetParams())
 static cmdlist_t cmdlist = {
-#ifdef USE_SQLITE3
-    .short_opt = "c:H:P:T:q:s:DGhv",
-#else
-    .short_opt = "c:H:P:T:m:u:p:DGhv",
-#endif
+    .short_opt = "c:S:H:P:T:M:N:g:i:R:A:W:V:O:L:B:q:s:m:u:p:F:DGw:Q:C:K:l:Ihv",
     .optaux = optdetails,
     .long_opt = {
 	//name       has_arg            flag  ltr
 	{"config",   required_argument, NULL, 'c'},
-//  {"source",   required_argument, NULL, 'S'},
+	{"source",   required_argument, NULL, 'S'},
 	{"host",     required_argument, NULL, 'H'},
 	{"port",     required_argument, NULL, 'P'},
 	{"topic",    required_argument, NULL, 'T'},
-#ifdef USE_SQLITE3
+	{"models",   required_argument, NULL, 'M'},
+	{"nomodels", required_argument, NULL, 'N'},
+	{"share",    required_argument, NULL, 'g'},
+	{"instance", required_argument, NULL, 'i'},
+	{"pubtopic", required_argument, NULL, 'R'},
+	{"aggregate", required_argument, NULL, 'A'},
+	{"http",     required_argument, NULL, 'W'},
+	{"viewdir",  required_argument, NULL, 'V'},
+	{"latest",   required_argument, NULL, 'O'},
+	{"lagbudget", required_argument, NULL, 'L'},
+    {"backend",  required_argument, NULL, 'B'},
     {"sql3path", required_argument, NULL, 'q'},
     {"sql3file", required_argument, NULL, 's'},
-#else
     {"myhost",   required_argument, NULL, 'm'},
     {"myuser",   required_argument, NULL, 'u'},
     {"mypass" ,  required_argument, NULL, 'p'},
-#endif
+    {"datafile", required_argument, NULL, 'F'},
     {"debug",    no_argument,       NULL, 'D'},
     {"Gdebug",   no_argument,       NULL, 'G'},
+    {"statefile", required_argument, NULL, 'w'},
+    {"spoolfile", required_argument, NULL, 'Q'},
+    {"capturedir", required_argument, NULL, 'C'},
+    {"capturekeep", required_argument, NULL, 'K'},
+    {"log",      required_argument, NULL, 'l'},
+    {"import",   no_argument,       NULL, 'I'},
     {"help",     no_argument,       NULL, 'h'},
     {"version",  no_argument,       NULL, 'v'},
     {NULL,       0,                 NULL,  0 }
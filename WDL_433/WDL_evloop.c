@@ -0,0 +1,319 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_evloop.c
+    Event loop for WDL_433, weather data logger for rtl_433
+
+    One epoll instance per loop watches
+      - the file descriptors registered with evAddFd();
+      - a timerfd, armed for the earliest pending timer;
+      - a signalfd for SIGINT, SIGTERM, SIGHUP, and SIGUSR1.
+    Timers are kept in a binary min-heap ordered by deadline, so the
+    loop never polls or sleeps: it waits in epoll_wait() until one of
+    those descriptors is ready.
+
+    Each loop is used by one thread only.  main() runs 'mainLoop';
+    other threads may create and run their own.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "WDL_433.h"
+
+#define EV_MAXEVENTS 32
+#define EV_MAXIDLE    8
+
+typedef struct {
+    int      fd;
+    evfd_cb  cb;
+    void    *arg;
+} evfd_t;
+
+typedef struct {
+    int64_t    when;          // deadline, monotonic msec
+    long       ms;            // repeat interval, or 0 for one-shot
+    int        id;
+    evtimer_cb cb;
+    void      *arg;
+} evtimer_t;
+
+struct evloop {
+    int        epfd;
+    int        tfd;           // timerfd for the earliest timer
+    int        sfd;           // signalfd, or -1
+    bool       running;
+    evfd_t   **fds;           // indexed by fd
+    int        nfds;
+    evtimer_t *heap;          // min-heap of timers by deadline
+    int        ntimers, maxtimers, nextid;
+    int64_t    armed;         // deadline the timerfd is set for
+    evsig_cb   sigcb;
+    void      *sigarg;
+    evidle_cb  idlecb[EV_MAXIDLE];
+    void      *idlearg[EV_MAXIDLE];
+    int        nidle;
+};
+
+evloop_t *mainLoop = NULL;
+
+int64_t evNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+};
+
+static void *evAlloc(void *p, size_t size) {
+    if ( (p = realloc(p, size)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory in event loop\n");
+        exit(EXIT_FAILURE);
+    };
+    return p;
+};
+
+// Arm the timerfd for the earliest timer (or disarm it if there are none)
+static void evArm(evloop_t *ev) {
+    struct itimerspec its;
+    int64_t when = (ev->ntimers > 0) ? ev->heap[0].when : 0;
+    if (when == ev->armed) return;
+    memset(&its, 0, sizeof(its));
+    if (when > 0) {
+        its.it_value.tv_sec  = when / 1000;
+        its.it_value.tv_nsec = (when % 1000) * 1000000;
+    };
+    timerfd_settime(ev->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+    ev->armed = when;
+};
+
+static void heapSwap(evloop_t *ev, int i, int j) {
+    evtimer_t t = ev->heap[i];
+    ev->heap[i] = ev->heap[j];
+    ev->heap[j] = t;
+};
+
+static void heapUp(evloop_t *ev, int i) {
+    while ( (i > 0) && (ev->heap[(i-1)/2].when > ev->heap[i].when) ) {
+        heapSwap(ev, i, (i-1)/2);
+        i = (i-1)/2;
+    };
+};
+
+static void heapDown(evloop_t *ev, int i) {
+    for (;;) {
+        int l = 2*i+1, r = l+1, m = i;
+        if ( (l < ev->ntimers) && (ev->heap[l].when < ev->heap[m].when) ) m = l;
+        if ( (r < ev->ntimers) && (ev->heap[r].when < ev->heap[m].when) ) m = r;
+        if (m == i) return;
+        heapSwap(ev, i, m);
+        i = m;
+    };
+};
+
+static void heapRemove(evloop_t *ev, int i) {
+    ev->ntimers--;
+    if (i == ev->ntimers) return;
+    ev->heap[i] = ev->heap[ev->ntimers];
+    heapDown(ev, i);
+    heapUp(ev, i);
+};
+
+static void heapInsert(evloop_t *ev, evtimer_t *t) {
+    if (ev->ntimers == ev->maxtimers) {
+        ev->maxtimers = (ev->maxtimers == 0) ? 16 : 2*ev->maxtimers;
+        ev->heap = evAlloc(ev->heap, ev->maxtimers*sizeof(evtimer_t));
+    };
+    ev->heap[ev->ntimers] = *t;
+    heapUp(ev, ev->ntimers++);
+};
+
+int evTimer(evloop_t *ev, long ms, bool repeat, evtimer_cb cb, void *arg) {
+    evtimer_t t;
+    if (ms < 1) ms = 1;
+    t.when = evNow() + ms;
+    t.ms   = repeat ? ms : 0;
+    t.cb   = cb;
+    t.arg  = arg;
+    if (++ev->nextid <= 0) ev->nextid = 1;
+    t.id   = ev->nextid;
+    heapInsert(ev, &t);
+    evArm(ev);
+    return t.id;
+};
+
+void evCancel(evloop_t *ev, int id) {
+    for (int i = 0; i < ev->ntimers; i++)
+        if (ev->heap[i].id == id) {
+            heapRemove(ev, i);
+            evArm(ev);
+            return;
+        };
+};
+
+// Run the timers that have expired
+static void evTimers(evloop_t *ev) {
+    uint64_t expirations;
+    int64_t  now = evNow();
+    if (read(ev->tfd, &expirations, sizeof(expirations)) < 0) {};
+    ev->armed = 0;
+    while ( (ev->ntimers > 0) && (ev->heap[0].when <= now) ) {
+        evtimer_t t = ev->heap[0];
+        if (t.ms > 0) {
+            // Reschedule from the deadline, skipping any missed intervals
+            do ev->heap[0].when += t.ms; while (ev->heap[0].when <= now);
+            heapDown(ev, 0);
+        } else
+            heapRemove(ev, 0);
+        t.cb(t.arg);
+    };
+    evArm(ev);
+};
+
+bool evAddFd(evloop_t *ev, int fd, uint32_t events, evfd_cb cb, void *arg) {
+    struct epoll_event e;
+    if (fd >= ev->nfds) {
+        int n = fd + 16;
+        ev->fds = evAlloc(ev->fds, n*sizeof(evfd_t *));
+        memset(ev->fds + ev->nfds, 0, (n - ev->nfds)*sizeof(evfd_t *));
+        ev->nfds = n;
+    };
+    if (ev->fds[fd] == NULL) ev->fds[fd] = evAlloc(NULL, sizeof(evfd_t));
+    ev->fds[fd]->fd  = fd;
+    ev->fds[fd]->cb  = cb;
+    ev->fds[fd]->arg = arg;
+    e.events   = events;
+    e.data.ptr = ev->fds[fd];
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) != 0) {
+        LOG(LM_EV, LV_ERR, "Can't watch file descriptor %d: %s\n", fd, strerror(errno));
+        free(ev->fds[fd]);
+        ev->fds[fd] = NULL;
+        return false;
+    };
+    return true;
+};
+
+bool evModFd(evloop_t *ev, int fd, uint32_t events) {
+    struct epoll_event e;
+    if ( (fd < 0) || (fd >= ev->nfds) || (ev->fds[fd] == NULL) ) return false;
+    e.events   = events;
+    e.data.ptr = ev->fds[fd];
+    return (epoll_ctl(ev->epfd, EPOLL_CTL_MOD, fd, &e) == 0);
+};
+
+void evDelFd(evloop_t *ev, int fd) {
+    if ( (fd < 0) || (fd >= ev->nfds) || (ev->fds[fd] == NULL) ) return;
+    epoll_ctl(ev->epfd, EPOLL_CTL_DEL, fd, NULL);
+    // Leave the entry allocated but unused: an event for it may
+    // already be pending in this pass of the loop
+    ev->fds[fd]->cb = NULL;
+};
+
+void evIdle(evloop_t *ev, evidle_cb cb, void *arg) {
+    if (ev->nidle == EV_MAXIDLE) {
+        fprintf(stderr, "?WDL_433: too many event-loop idle procedures\n");
+        exit(EXIT_FAILURE);
+    };
+    ev->idlecb[ev->nidle]  = cb;
+    ev->idlearg[ev->nidle] = arg;
+    ev->nidle++;
+};
+
+static sigset_t evSigSet(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+    return mask;
+};
+
+void evBlockSignals(void) {
+    sigset_t mask = evSigSet();
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+};
+
+bool evSignals(evloop_t *ev, evsig_cb cb, void *arg) {
+    sigset_t mask = evSigSet();
+    ev->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (ev->sfd < 0) {
+        LOG(LM_EV, LV_ERR, "Can't create signalfd: %s\n", strerror(errno));
+        return false;
+    };
+    ev->sigcb  = cb;
+    ev->sigarg = arg;
+    return true;
+};
+
+evloop_t *evNew(void) {
+    struct epoll_event e;
+    evloop_t *ev = evAlloc(NULL, sizeof(evloop_t));
+    memset(ev, 0, sizeof(evloop_t));
+    ev->sfd  = -1;
+    ev->epfd = epoll_create1(EPOLL_CLOEXEC);
+    ev->tfd  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ( (ev->epfd < 0) || (ev->tfd < 0) ) {
+        fprintf(stderr, "?WDL_433: can't create event loop: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    // The timerfd and signalfd are marked by NULL and &ev->sfd
+    e.events   = EPOLLIN;
+    e.data.ptr = NULL;
+    epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->tfd, &e);
+    return ev;
+};
+
+void evFree(evloop_t *ev) {
+    for (int i = 0; i < ev->nfds; i++) free(ev->fds[i]);
+    free(ev->fds);
+    free(ev->heap);
+    close(ev->tfd);
+    if (ev->sfd >= 0) close(ev->sfd);
+    close(ev->epfd);
+    free(ev);
+};
+
+void evStop(evloop_t *ev) {
+    ev->running = false;
+};
+
+void evRun(evloop_t *ev) {
+    struct epoll_event events[EV_MAXEVENTS];
+    struct signalfd_siginfo si;
+    if (ev->sfd >= 0) {
+        struct epoll_event e;
+        e.events   = EPOLLIN;
+        e.data.ptr = &ev->sfd;
+        epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->sfd, &e);
+    };
+    ev->running = true;
+    while (ev->running) {
+        for (int i = 0; i < ev->nidle; i++) ev->idlecb[i](ev->idlearg[i]);
+        int n = epoll_wait(ev->epfd, events, EV_MAXEVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG(LM_EV, LV_ERR, "epoll_wait failed: %s\n", strerror(errno));
+            break;
+        };
+        for (int i = 0; (i < n) && ev->running; i++) {
+            if (events[i].data.ptr == NULL)
+                evTimers(ev);
+            else if (events[i].data.ptr == &ev->sfd) {
+                while (read(ev->sfd, &si, sizeof(si)) == sizeof(si))
+                    if (ev->sigcb != NULL) ev->sigcb(si.ssi_signo, ev->sigarg);
+            } else {
+                evfd_t *f = events[i].data.ptr;
+                if (f->cb != NULL) f->cb(f->fd, events[i].events, f->arg);
+            };
+        };
+    };
+};
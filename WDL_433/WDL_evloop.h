@@ -0,0 +1,55 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*
+    WDL_evloop.h
+    Definitions for the event loop of WDL_433
+
+    The event loop waits (epoll) for any of a set of file descriptors
+    to become ready, for timers to expire, or for signals to arrive,
+    and calls the procedure registered for that event.  The MQTT
+    connection, other packet sources, and periodic work such as
+    saving state all run from the same loop in the main thread.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+typedef struct evloop evloop_t;
+
+typedef void (*evfd_cb)(int fd, uint32_t events, void *arg);
+typedef void (*evtimer_cb)(void *arg);
+typedef void (*evsig_cb)(int signo, void *arg);
+typedef void (*evidle_cb)(void *arg);
+
+// The event loop run by main()
+extern evloop_t *mainLoop;
+
+evloop_t *evNew(void);
+void evFree(evloop_t *ev);
+void evRun(evloop_t *ev);
+void evStop(evloop_t *ev);
+
+// Watch 'fd' for 'events' (EPOLLIN, EPOLLOUT); 'cb' gets the events that occurred
+bool evAddFd(evloop_t *ev, int fd, uint32_t events, evfd_cb cb, void *arg);
+bool evModFd(evloop_t *ev, int fd, uint32_t events);
+void evDelFd(evloop_t *ev, int fd);
+
+// Call 'cb' after 'ms' milliseconds, and every 'ms' thereafter if 'repeat'
+// Returns an id for evCancel(), or 0 on failure
+int  evTimer(evloop_t *ev, long ms, bool repeat, evtimer_cb cb, void *arg);
+void evCancel(evloop_t *ev, int id);
+
+// Call 'cb' before each wait for events (e.g., to update EPOLLOUT interest)
+void evIdle(evloop_t *ev, evidle_cb cb, void *arg);
+
+// Block SIGINT, SIGTERM, SIGHUP, and SIGUSR1 so they can be delivered
+// through evSignals(); must be called before any threads are created
+void evBlockSignals(void);
+bool evSignals(evloop_t *ev, evsig_cb cb, void *arg);
+
+// Milliseconds on the monotonic clock
+int64_t evNow(void);
@@ -0,0 +1,175 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_file.c
+    Flat-file storage backend for WDL_433, weather data logger for rtl_433
+    Selected with 'backend = file'.
+
+    Records are appended to 'datafile' as fixed-size binary records,
+    with no database at all:
+        fileHdr              magic, version, record size
+        fileRec[]            records, in the order they were committed
+    in the byte order of the host that wrote them.  Each batch is
+    written with one write() and committed with fdatasync().
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "WDL_433.h"
+
+extern bool  DEBUG;
+extern char *dataFile;
+
+#define FILE_MAGIC   "WDL433D"
+#define FILE_VERSION 1
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recsize;         // sizeof(fileRec) when written
+} fileHdr;
+
+typedef struct {
+    char     date_time[20];
+    char     sensorID[50];
+    double   temp1;
+    double   temp2;
+    double   rh;
+    double   press;
+    double   light;
+} fileRec;
+
+static int      fd   = -1;    // open for appending, while prepared
+static fileRec *recs = NULL;  // batch being written
+static int      maxrecs = 0;
+
+// Check that the data file exists and is one of ours, creating it if necessary
+static bool fileInit(sink_t *sk) {
+    fileHdr hdr;
+    int     f;
+    ssize_t n;
+
+    if ( (f = open(dataFile, O_RDWR|O_CREAT|O_CLOEXEC, 0644)) < 0 ) {
+        fprintf(stderr, "?Can't open or create data file '%s': %s\n",
+                dataFile, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    n = read(f, &hdr, sizeof(hdr));
+    if (n == 0) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        hdr.version = FILE_VERSION;
+        hdr.recsize = sizeof(fileRec);
+        if (write(f, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+            fprintf(stderr, "?Can't write data file '%s': %s\n", dataFile, strerror(errno));
+            exit(EXIT_FAILURE);
+        };
+    } else if ( (n != sizeof(hdr)) || (memcmp(hdr.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+                || (hdr.version != FILE_VERSION) || (hdr.recsize != sizeof(fileRec)) ) {
+        fprintf(stderr, "?'%s' is not a WDL_433 data file or is from another version\n",
+                dataFile);
+        exit(EXIT_FAILURE);
+    };
+    close(f);
+    if (DEBUG) printf("Recording to data file '%s'\n", dataFile);
+    return true;
+};
+
+static bool filePrepare(void) {
+    if (fd >= 0) return true;
+    if ( (fd = open(dataFile, O_WRONLY|O_APPEND|O_CLOEXEC)) < 0 ) {
+        LOG(LM_DB, LV_ERR, "Can't open data file '%s': %s\n", dataFile, strerror(errno));
+        return false;
+    };
+    return true;
+};
+
+static void fileClose(void) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+};
+
+// Append 'n' records with one write; 'done' is called before returning
+static void fileAppend(DBRecord *rows, int n, dbdone_cb done, void *arg) {
+    size_t  len = n*sizeof(fileRec);
+    ssize_t w;
+
+    if (n > maxrecs) {
+        maxrecs = n;
+        if ( (recs = realloc(recs, maxrecs*sizeof(fileRec))) == NULL ) {
+            fprintf(stderr, "?Out of memory for data file records\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    memset(recs, 0, len);
+    for (int i = 0; i < n; i++) {
+        strncpy(recs[i].date_time, rows[i].date_time, sizeof(recs[i].date_time)-1);
+        strncpy(recs[i].sensorID,  rows[i].sensorID,  sizeof(recs[i].sensorID)-1);
+        recs[i].temp1 = rows[i].temp1;
+        recs[i].temp2 = rows[i].temp2;
+        recs[i].rh    = rows[i].rh;
+        recs[i].press = rows[i].press;
+        recs[i].light = rows[i].light;
+    };
+    w = write(fd, recs, len);
+    if ( (w != (ssize_t)len) || (fdatasync(fd) != 0) ) {
+        LOG(LM_DB, LV_ERR, "Can't write data file '%s': %s\n", dataFile,
+            (w < 0) ? strerror(errno) : "short write");
+        // Drop a partial record so the file stays aligned
+        if (w > 0) {
+            struct stat st;
+            if ( (fstat(fd, &st) == 0) && (ftruncate(fd, st.st_size - w) != 0) ) {};
+        };
+        fileClose();
+        done(arg, DB_DOWN);
+        return;
+    };
+    done(arg, DB_OK);
+};
+
+static void fileFlush(void) {
+};
+
+// Pass every record's sensorID and time to 'cb', oldest first
+static void fileLastTimes(void (*cb)(char *sensorID, char *date_time)) {
+    struct stat st;
+    char   *map, sensorID[51], date_time[21];
+    int     f;
+    size_t  n;
+
+    if ( (f = open(dataFile, O_RDONLY)) < 0 ) return;
+    if ( (fstat(f, &st) != 0) || ((size_t)st.st_size <= sizeof(fileHdr)) ) {
+        close(f);
+        return;
+    };
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+    close(f);
+    if (map == MAP_FAILED) return;
+    n = (st.st_size - sizeof(fileHdr))/sizeof(fileRec);
+    fileRec *r = (fileRec *)(map + sizeof(fileHdr));
+    for (size_t i = 0; i < n; i++) {
+        snprintf(sensorID,  sizeof(sensorID),  "%.50s", r[i].sensorID);
+        snprintf(date_time, sizeof(date_time), "%.20s", r[i].date_time);
+        cb(sensorID, date_time);
+    };
+    munmap(map, st.st_size);
+};
+
+backend_t fileBackend = {
+    .name        = "file",
+    .init        = fileInit,
+    .prepare     = filePrepare,
+    .appendBatch = fileAppend,
+    .flush       = fileFlush,
+    .close       = fileClose,
+    .lastTimes   = fileLastTimes,
+};
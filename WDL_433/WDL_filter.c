@@ -0,0 +1,642 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_filter.c
+    Packet filter rules for WDL_433, weather data logger for rtl_433
+
+    Each entry in the [filters] section of WDL_433.ini is a rule,
+        name = accept|reject condition ...
+    and the first rule whose conditions all hold decides whether a
+    packet is recorded; 'default = accept|reject' decides the packets
+    no rule matches (accept, if it isn't given).  For example
+        [filters]
+        tpms     = reject type=TPMS
+        soil     = reject model=Fineoffset-WH51
+        freezer  = reject key=Acurite-986/3079/2F
+        badtemp  = reject temperature_C!=-40..70
+        notemp   = reject !temperature_C
+    A condition tests a field of the packet's JSON, or 'key', the
+    'model'/'id'/'channel' sensorID a packet is recorded by:
+        field            the packet has the field
+        !field           it doesn't
+        field=pattern    the field's text matches the pattern, in which
+                         '*' is any text and '?' any char
+        field!=pattern   the field's text doesn't match (or it's missing)
+        field<n, field<=n, field>n, field>=n
+                         the field is a number in that range
+        field=lo..hi     the field is a number from lo to hi
+        field!=lo..hi    it isn't (or it's missing)
+    Without a [filters] section, packets with no temperature or with
+    "TPMS" in them are rejected, as before rules were introduced.
+
+    The rules are compiled when WDL_433 starts, and when the .ini file is
+    reloaded (SIGHUP).  Each distinct condition is a bit; a packet's
+    JSON is scanned once, and each field a rule names is found in a
+    hash table and sets its bits: the patterns on a field are compiled
+    together into one DFA, run once over the field's text, and the
+    numbers a field is compared with cut the number line into
+    intervals, found by binary search, each with the bits true in it.
+    The rules are then a table of (mask, want) pairs, and the first for
+    which (bits & mask) == want decides.  That last step is a scan of
+    the rules, but of at most FILTER_RULES, with an AND and a compare
+    each: the scan of the packet costs far more.
+
+    Most packets on a busy band come from a few sensors, decided by the
+    same rule every time, so a sensor's verdict is cached: its sensorID
+    is taken from the first fields of its packet and looked up in a
+    fixed-size table, and a packet decided there isn't scanned further
+    (nor, if it's rejected, parsed).  A verdict is cached only if the
+    rules up to the one that decided it test nothing but 'model', 'id',
+    'channel' and 'key', so put those rules first.  The cache is
+    cleared whenever the rules are compiled.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "WDL_433.h"
+
+#define FILTER_RULES   64         // most rules
+#define FILTER_PREDS   64         // most distinct conditions: bits in a uint64_t
+#define FILTER_FIELDS  32         // most fields named by rules
+#define FILTER_HASH    64         // slots in the field hash table
+#define FILTER_STATES  4096       // most states in a field's DFA
+#define FILTER_TEXT    64         // chars of a field name or value examined
+#define FILTER_CACHE   1024       // entries in the verdict cache
+
+typedef enum { P_PRESENT, P_GLOB, P_LT, P_LE, P_GT, P_GE, P_IN } pkind_t;
+
+// A condition, compiled to bit number its index in preds[]
+typedef struct {
+    pkind_t kind;
+    int     field;
+    double  a, b;
+    char   *glob;
+} pred_t;
+
+// The DFA for the patterns on a field; state 0 is dead, state 1 the start
+typedef struct {
+    int       nclass;
+    uint8_t   cls[256];           // char class of each char
+    int       nstates;            // 0 if the field has no patterns
+    uint16_t *next;               // [state*nclass + class]
+    uint64_t *accept;             // conditions that hold if the text ends there
+} dfa_t;
+
+typedef struct {
+    char     *name;
+    uint64_t  present;            // its P_PRESENT bit, if a rule tests that
+    dfa_t     dfa;
+    int       nbounds;
+    double   *bounds;             // numbers it's compared with, ascending
+    uint64_t *region;             // bits true in each of the 2*nbounds+1 intervals
+} field_t;
+
+typedef struct {
+    char         *name;
+    bool          accept;
+    uint64_t      mask, want;
+    unsigned long hits;
+} rule_t;
+
+// A set of rules, compiled
+typedef struct {
+    pred_t        preds[FILTER_PREDS];
+    field_t       fields[FILTER_FIELDS];
+    rule_t        rules[FILTER_RULES];
+    int           npreds, nfields, nrules;
+    int           hash[FILTER_HASH];      // index+1 in fields[], 0 if free
+    int           keyField;               // 'key', the sensorID, if a rule names it
+    bool          dflt;
+    unsigned long dfltHits;
+    // The verdict cache: for a sensor whose packets are all decided by the
+    //   same rule, its sensorID's hash, less the low byte, and the rule's
+    //   index+1 (nrules+1 for the default), at the hash modulo FILTER_CACHE.
+    //   Entries are single words, so threads share it without locks
+    uint64_t      cache[FILTER_CACHE];
+    int           keyRules;               // leading rules that test only the sensorID
+    unsigned long cacheHits;
+    char         *text;                   // the rule being parsed, if it's invalid
+} filterset_t;
+
+// The rules in force, and those being read from the .ini file, put in
+//   force by filterInit()
+static filterset_t *filters = NULL, *building = NULL;
+
+static void filterError(char *name, char *what) {
+    fprintf(stderr, "?WDL_433: invalid [filters] entry '%s': %s\n"
+            "\tuse e.g. 'reject model=Acurite-986 temperature_C<-30'\n", name, what);
+    iniInvalid();
+};
+
+// The set of rules being read, started if need be
+static filterset_t *filterBuilding(void) {
+    if (building == NULL) {
+        if ( (building = calloc(1, sizeof(filterset_t))) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for [filters]\n");
+            exit(EXIT_FAILURE);
+        };
+        building->keyField = -1;
+        building->dflt     = true;
+    };
+    return building;
+};
+
+static void filterFree(filterset_t *fs) {
+    if (fs == NULL) return;
+    for (int p = 0; p < fs->npreds; p++) free(fs->preds[p].glob);
+    for (int f = 0; f < fs->nfields; f++) {
+        free(fs->fields[f].name);
+        free(fs->fields[f].dfa.next);
+        free(fs->fields[f].dfa.accept);
+        free(fs->fields[f].bounds);
+        free(fs->fields[f].region);
+    };
+    for (int r = 0; r < fs->nrules; r++) free(fs->rules[r].name);
+    free(fs->text);
+    free(fs);
+};
+
+// Drop the rules read so far, if the .ini file they're in can't be used
+void filterAbort(void) {
+    filterFree(building);
+    building = NULL;
+};
+
+static unsigned fieldHash(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+};
+
+// The index in fields[] of field 'name', adding it if 'add'; -1 if it isn't there
+static int fieldFind(filterset_t *fs, const char *name, bool add) {
+    unsigned h = fieldHash(name) % FILTER_HASH;
+    while (fs->hash[h] != 0) {
+        if (strcmp(fs->fields[fs->hash[h]-1].name, name) == 0) return fs->hash[h]-1;
+        h = (h + 1) % FILTER_HASH;
+    };
+    if (!add) return -1;
+    if (fs->nfields == FILTER_FIELDS) return -2;
+    fs->fields[fs->nfields].name = strdup(name);
+    fs->hash[h] = ++fs->nfields;
+    if (strcmp(name, "key") == 0) fs->keyField = fs->nfields-1;
+    return fs->nfields-1;
+};
+
+// The bit number of a condition, adding it if it's new
+static int predFind(filterset_t *fs, char *name, pkind_t kind, int field, double a, double b, char *glob) {
+    int p;
+    for (p = 0; p < fs->npreds; p++)
+        if ( (fs->preds[p].kind == kind) && (fs->preds[p].field == field) && (fs->preds[p].a == a)
+             && (fs->preds[p].b == b)
+             && ((glob == NULL) || (strcmp(fs->preds[p].glob, glob) == 0)) ) return p;
+    if (fs->npreds == FILTER_PREDS) filterError(name, "too many conditions in [filters]");
+    fs->preds[p].kind  = kind;
+    fs->preds[p].field = field;
+    fs->preds[p].a     = a;
+    fs->preds[p].b     = b;
+    fs->preds[p].glob  = (glob == NULL) ? NULL : strdup(glob);
+    if (kind == P_PRESENT) fs->fields[field].present = (uint64_t)1 << p;
+    return fs->npreds++;
+};
+
+// Is 's' a number range, 'lo..hi'?
+static bool isRange(char *s, double *lo, double *hi) {
+    char *dots = strstr(s, ".."), *end;
+    if (dots == NULL) return false;
+    *dots = '\0';                  // strtod() would take "1." of "1..5"
+    *lo = strtod(s, &end);
+    *dots = '.';
+    if ( (end == s) || (end != dots) ) return false;
+    s = dots + 2;
+    *hi = strtod(s, &end);
+    return (end != s) && (*end == '\0') && (*lo <= *hi);
+};
+
+// Record the rule in the [filters] entry 'name = accept|reject condition ...'
+void setFilter(char *name, char *rule) {
+    filterset_t *fs = filterBuilding();
+    char   *text, *tok, *save, *op, *val, *end;
+    rule_t *r;
+    int     f, p;
+    bool    sense;
+    pkind_t kind;
+    double  a, b = 0;
+
+    // Kept in the set being built, so filterAbort() frees it if the rule is invalid
+    if ( (text = fs->text = strdup(rule)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for [filters]\n");
+        exit(EXIT_FAILURE);
+    };
+    tok = strtok_r(text, " \t,", &save);
+    if ( (tok == NULL) || ((strcmp(tok, "accept") != 0) && (strcmp(tok, "reject") != 0)) )
+        filterError(name, "a rule starts with 'accept' or 'reject'");
+    if (strcmp(name, "default") == 0) {
+        fs->dflt = (strcmp(tok, "accept") == 0);
+        if (strtok_r(NULL, " \t,", &save) != NULL) filterError(name, "the default has no conditions");
+        free(text);
+        fs->text = NULL;
+        return;
+    };
+    if (fs->nrules == FILTER_RULES) filterError(name, "too many rules in [filters]");
+    r = &fs->rules[fs->nrules];
+    r->accept = (strcmp(tok, "accept") == 0);
+    while ( (tok = strtok_r(NULL, " \t,", &save)) != NULL ) {
+        sense = true;
+        if (*tok == '!') {
+            // '!field': the field is missing
+            sense = false;
+            if (strpbrk(++tok, "=<>!") != NULL) filterError(name, tok-1);
+        };
+        op = strpbrk(tok, "=<>!");
+        if ( (op == tok) || (*tok == '\0') ) filterError(name, "a field name is missing");
+        kind = P_PRESENT;
+        val  = NULL;
+        if (op != NULL) {
+            if      (strncmp(op, "!=", 2) == 0) { sense = false; val = op+2; kind = P_GLOB; }
+            else if (strncmp(op, "<=", 2) == 0) { val = op+2; kind = P_LE; }
+            else if (strncmp(op, ">=", 2) == 0) { val = op+2; kind = P_GE; }
+            else if (*op == '<')                { val = op+1; kind = P_LT; }
+            else if (*op == '>')                { val = op+1; kind = P_GT; }
+            else if (*op == '=')                { val = op+1; kind = P_GLOB; }
+            else filterError(name, tok);
+            *op = '\0';
+        };
+        if ( (f = fieldFind(fs, tok, true)) < 0 ) filterError(name, "too many fields in [filters]");
+        a = 0;
+        if (kind == P_PRESENT)
+            p = predFind(fs, name, kind, f, 0, 0, NULL);
+        else if (kind != P_GLOB) {
+            a = strtod(val, &end);
+            if ( (end == val) || (*end != '\0') ) filterError(name, val);
+            p = predFind(fs, name, kind, f, a, 0, NULL);
+        } else if (isRange(val, &a, &b))
+            p = predFind(fs, name, P_IN, f, a, b, NULL);
+        else {
+            if (*val == '\0') filterError(name, "a pattern is missing");
+            if (strlen(val) >= FILTER_TEXT) filterError(name, val);
+            p = predFind(fs, name, P_GLOB, f, 0, 0, val);
+        };
+        r->mask |= (uint64_t)1 << p;
+        if (sense) r->want |= (uint64_t)1 << p;
+    };
+    free(text);
+    fs->text = NULL;
+    r->name  = strdup(name);
+    fs->nrules++;
+};
+
+// Is the set of NFA positions 'set' (of 'words' words) in the DFA's 'sets'?
+static int dfaState(uint64_t *sets, int nstates, uint64_t *set, int words) {
+    for (int s = 0; s < nstates; s++)
+        if (memcmp(&sets[s*words], set, words*sizeof(uint64_t)) == 0) return s;
+    return -1;
+};
+
+// Compile the patterns on field 'f' into its DFA, by subset construction.
+//   The NFA for the patterns has a position for each char of each pattern
+//   and one past it; a '*' stays or moves on, without taking a char
+static void dfaBuild(filterset_t *fs, field_t *f) {
+    dfa_t    *d = &f->dfa;
+    char     *pat[FILTER_PREDS];
+    int       off[FILTER_PREDS + 1], np = 0, words, j, i, c, s, t, maxStates = 64;
+    uint64_t  bit[FILTER_PREDS], *sets, *set;
+    uint8_t   rep[256];           // a char of each class
+    bool      lit[256] = { false };
+
+    for (int p = 0; p < fs->npreds; p++)
+        if ( (fs->preds[p].kind == P_GLOB) && (&fs->fields[fs->preds[p].field] == f) ) {
+            pat[np]   = fs->preds[p].glob;
+            bit[np++] = (uint64_t)1 << p;
+        };
+    if (np == 0) return;
+    off[0] = 0;
+    for (j = 0; j < np; j++) {
+        off[j+1] = off[j] + strlen(pat[j]) + 1;
+        for (char *ch = pat[j]; *ch; ch++)
+            if ( (*ch != '*') && (*ch != '?') ) lit[(uint8_t)*ch] = true;
+    };
+    words = (off[np] + 63)/64;
+
+    // Chars no pattern names are class 0; each one a pattern names has its own
+    d->nclass = 1;
+    rep[0] = 1;
+    for (c = 1; c < 256; c++)
+        if (lit[c]) { d->cls[c] = d->nclass; rep[d->nclass++] = c; }
+        else if (lit[rep[0]]) rep[0] = c;
+
+    sets      = calloc(maxStates, words*sizeof(uint64_t));
+    d->next   = malloc(maxStates*d->nclass*sizeof(uint16_t));
+    d->accept = calloc(maxStates, sizeof(uint64_t));
+    set       = malloc(words*sizeof(uint64_t));
+    if ( (sets == NULL) || (d->next == NULL) || (d->accept == NULL) || (set == NULL) ) {
+        fprintf(stderr, "?WDL_433: out of memory for [filters]\n");
+        exit(EXIT_FAILURE);
+    };
+
+    // Take the '*' moves from the positions in 'x'; they only go forward
+    #define HAS(x, n) ((x)[(n)/64] >> ((n)%64) & 1)
+    #define ADD(x, n) ((x)[(n)/64] |= (uint64_t)1 << ((n)%64))
+    #define CLOSE(x) for (j = 0; j < np; j++) \
+                         for (i = 0; pat[j][i]; i++) \
+                             if ( (pat[j][i] == '*') && HAS(x, off[j]+i) ) ADD(x, off[j]+i+1)
+
+    d->nstates = 2;               // the dead state, empty, and the start
+    for (j = 0; j < np; j++) ADD(&sets[words], off[j]);
+    CLOSE(&sets[words]);
+    for (s = 1; s < d->nstates; s++) {
+        for (j = 0; j < np; j++)
+            if (HAS(&sets[s*words], off[j] + strlen(pat[j]))) d->accept[s] |= bit[j];
+        for (c = 0; c < d->nclass; c++) {
+            memset(set, 0, words*sizeof(uint64_t));
+            for (j = 0; j < np; j++)
+                for (i = 0; pat[j][i]; i++) {
+                    if (!HAS(&sets[s*words], off[j]+i)) continue;
+                    if      (pat[j][i] == '*') ADD(set, off[j]+i);
+                    else if ( (pat[j][i] == '?') || ((uint8_t)pat[j][i] == rep[c]) )
+                        ADD(set, off[j]+i+1);
+                };
+            CLOSE(set);
+            if ( (t = dfaState(sets, d->nstates, set, words)) < 0 ) {
+                if (d->nstates == FILTER_STATES) {
+                    fprintf(stderr, "?WDL_433: the [filters] patterns on '%s' are too complex\n",
+                            f->name);
+                    free(set);
+                    free(sets);
+                    iniInvalid();
+                };
+                if (d->nstates == maxStates) {
+                    maxStates *= 2;
+                    sets      = realloc(sets, maxStates*words*sizeof(uint64_t));
+                    d->next   = realloc(d->next, maxStates*d->nclass*sizeof(uint16_t));
+                    d->accept = realloc(d->accept, maxStates*sizeof(uint64_t));
+                    if ( (sets == NULL) || (d->next == NULL) || (d->accept == NULL) ) {
+                        fprintf(stderr, "?WDL_433: out of memory for [filters]\n");
+                        exit(EXIT_FAILURE);
+                    };
+                };
+                t = d->nstates++;
+                memcpy(&sets[t*words], set, words*sizeof(uint64_t));
+                d->accept[t] = 0;
+            };
+            d->next[s*d->nclass + c] = t;
+        };
+    };
+    for (c = 0; c < d->nclass; c++) d->next[c] = 0;
+    d->accept[0] = 0;
+    #undef HAS
+    #undef ADD
+    #undef CLOSE
+    free(set);
+    free(sets);
+};
+
+static int boundCompare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y) ? -1 : (x > y);
+};
+
+static bool predHolds(pred_t *p, double v) {
+    switch (p->kind) {
+    case P_LT: return v <  p->a;
+    case P_LE: return v <= p->a;
+    case P_GT: return v >  p->a;
+    case P_GE: return v >= p->a;
+    case P_IN: return (v >= p->a) && (v <= p->b);
+    default:   return false;
+    };
+};
+
+// Cut the number line at the numbers field 'f' is compared with, and
+//   work out which comparisons hold in each interval, and at each cut
+static void regionBuild(filterset_t *fs, field_t *f) {
+    int n = 0, r, p;
+    double v;
+    for (p = 0; p < fs->npreds; p++)
+        if ( (&fs->fields[fs->preds[p].field] == f) && (fs->preds[p].kind >= P_LT) ) n += 2;
+    if (n == 0) return;
+    if ( ((f->bounds = malloc(n*sizeof(double))) == NULL)
+         || ((f->region = calloc(2*n+1, sizeof(uint64_t))) == NULL) ) {
+        fprintf(stderr, "?WDL_433: out of memory for [filters]\n");
+        exit(EXIT_FAILURE);
+    };
+    for (p = 0; p < fs->npreds; p++)
+        if ( (&fs->fields[fs->preds[p].field] == f) && (fs->preds[p].kind >= P_LT) ) {
+            f->bounds[f->nbounds++] = fs->preds[p].a;
+            if (fs->preds[p].kind == P_IN) f->bounds[f->nbounds++] = fs->preds[p].b;
+        };
+    qsort(f->bounds, f->nbounds, sizeof(double), boundCompare);
+    for (n = 0, r = 0; r < f->nbounds; r++)
+        if ( (n == 0) || (f->bounds[r] != f->bounds[n-1]) ) f->bounds[n++] = f->bounds[r];
+    f->nbounds = n;
+    // Interval 2i+1 is bounds[i] itself; 2i is below it, and above bounds[i-1]
+    for (r = 0; r <= 2*n; r++) {
+        if      (r & 1)  v = f->bounds[r/2];
+        else if (r == 0) v = f->bounds[0] - 1;
+        else if (r == 2*n) v = f->bounds[n-1] + 1;
+        else             v = (f->bounds[r/2-1] + f->bounds[r/2])/2;
+        for (p = 0; p < fs->npreds; p++)
+            if ( (&fs->fields[fs->preds[p].field] == f) && predHolds(&fs->preds[p], v) )
+                f->region[r] |= (uint64_t)1 << p;
+    };
+};
+
+// Compile the rules once they've all been read, and put them in force in
+//   place of those in force (if the .ini file is being reloaded); without
+//   rules, the built-in tests apply.  Packets are decided on the main
+//   thread, as is a reload, so none is being decided by the rules replaced
+void filterInit(void) {
+    filterset_t *fs = filterBuilding(), *old = filters;
+    uint64_t     keyBits = 0;
+    for (int f = 0; f < fs->nfields; f++) {
+        dfaBuild(fs, &fs->fields[f]);
+        regionBuild(fs, &fs->fields[f]);
+    };
+    // A sensor's packets all get the same verdict from the rules, up to
+    //   the first that tests more than 'model', 'id', 'channel' and 'key'
+    for (int p = 0; p < fs->npreds; p++) {
+        char *name = fs->fields[fs->preds[p].field].name;
+        if ( (strcmp(name, "model") == 0) || (strcmp(name, "id") == 0)
+             || (strcmp(name, "channel") == 0) || (strcmp(name, "key") == 0) )
+            keyBits |= (uint64_t)1 << p;
+    };
+    for (fs->keyRules = 0; fs->keyRules < fs->nrules; fs->keyRules++)
+        if ( (fs->rules[fs->keyRules].mask & ~keyBits) != 0 ) break;
+    memset(fs->cache, 0, sizeof(fs->cache));
+    if (fs->nrules > 0)
+        LOG(LM_MAIN, LV_DEBUG, "%d filter rules: %d conditions on %d fields\n",
+            fs->nrules, fs->npreds, fs->nfields);
+    __atomic_store_n(&filters, fs, __ATOMIC_RELEASE);
+    building = NULL;
+    filterFree(old);
+};
+
+bool filterActive(void) {
+    filterset_t *fs = __atomic_load_n(&filters, __ATOMIC_ACQUIRE);
+    return (fs != NULL) && (fs->nrules > 0);
+};
+
+// The conditions that hold for field 'f', whose text is 'text'
+static uint64_t fieldBits(field_t *f, const char *text) {
+    uint64_t    bits = f->present;
+    const char *c;
+    char       *end;
+    double      v;
+    int         s, lo, hi, mid;
+
+    if (f->dfa.nstates > 0) {
+        for (s = 1, c = text; *c && (s != 0); c++)
+            s = f->dfa.next[s*f->dfa.nclass + f->dfa.cls[(uint8_t)*c]];
+        bits |= f->dfa.accept[s];
+    };
+    if (f->nbounds > 0) {
+        v = strtod(text, &end);
+        if ( (end != text) && (*end == '\0') && !isnan(v) ) {
+            // Find the first bound at or above 'v'
+            for (lo = 0, hi = f->nbounds; lo < hi; ) {
+                mid = (lo + hi)/2;
+                if (f->bounds[mid] < v) lo = mid + 1;
+                else                    hi = mid;
+            };
+            bits |= f->region[((lo < f->nbounds) && (f->bounds[lo] == v)) ? 2*lo+1 : 2*lo];
+        };
+    };
+    return bits;
+};
+
+// Copy the JSON string at 's', just past its opening quote, to 'buf', as
+//   much as fits; return what follows its closing quote, or NULL
+static const char *scanString(const char *s, char *buf) {
+    int n = 0;
+    char c;
+    while ( (c = *s++) != '"' ) {
+        if (c == '\0') return NULL;
+        if (c == '\\') {
+            if ( (c = *s++) == '\0' ) return NULL;
+            if      (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+        };
+        if (n < FILTER_TEXT-1) buf[n++] = c;
+    };
+    buf[n] = '\0';
+    return s;
+};
+
+// Copy the JSON value at 's' to 'buf' (strings without their quotes;
+//   objects and arrays are skipped); return what follows it, or NULL
+static const char *scanValue(const char *s, char *buf) {
+    int n = 0, depth = 0;
+    if (*s == '"') return scanString(s+1, buf);
+    buf[0] = '\0';
+    if ( (*s == '{') || (*s == '[') ) {
+        do {
+            if      ( (*s == '{') || (*s == '[') ) depth++;
+            else if ( (*s == '}') || (*s == ']') ) depth--;
+            else if (*s == '"') {
+                if ( (s = scanString(s+1, buf)) == NULL ) return NULL;
+                continue;
+            } else if (*s == '\0') return NULL;
+            s++;
+        } while (depth > 0);
+        buf[0] = '\0';
+        return s;
+    };
+    while ( (*s != '\0') && (*s != ',') && (*s != '}') && !isspace((uint8_t)*s) ) {
+        if (n < FILTER_TEXT-1) buf[n++] = *s;
+        s++;
+    };
+    buf[n] = '\0';
+    return s;
+};
+
+// Scan the '"key": value' pair at 's' into 'key' and 'val'; return what
+//   follows it, or NULL at the end of the object
+static const char *scanPair(const char *s, char *key, char *val) {
+    while ( isspace((uint8_t)*s) || (*s == ',') ) s++;
+    if ( (*s != '"') || ((s = scanString(s+1, key)) == NULL) ) return NULL;
+    while (isspace((uint8_t)*s)) s++;
+    if (*s++ != ':') return NULL;
+    while (isspace((uint8_t)*s)) s++;
+    return scanValue(s, val);
+};
+
+// The packet's sensorID, 'model'/'id'/'channel', scanning only as far as
+//   those fields (rtl_433 puts them first); false if it has no model
+static bool packetKey(const char *s, char *sensorID, size_t size) {
+    char key[FILTER_TEXT], val[FILTER_TEXT];
+    char model[FILTER_TEXT] = "", id[FILTER_TEXT] = "", chnl[FILTER_TEXT] = "";
+    int  found = 0;
+    while (isspace((uint8_t)*s)) s++;
+    if (*s++ != '{') return false;
+    while ( (found < 3) && ((s = scanPair(s, key, val)) != NULL) ) {
+        if      (strcmp(key, "model")   == 0) { strcpy(model, val); found++; }
+        else if (strcmp(key, "id")      == 0) { strcpy(id, val);    found++; }
+        else if (strcmp(key, "channel") == 0) { strcpy(chnl, val);  found++; }
+    };
+    snprintf(sensorID, size, "%s/%s/%s", model, id, chnl);
+    return (model[0] != '\0');
+};
+
+// Count the packet decided by rule 'r' (nrules: the default), and give its verdict
+static bool verdict(filterset_t *fs, int r) {
+    if (r == fs->nrules) {
+        __atomic_add_fetch(&fs->dfltHits, 1, __ATOMIC_RELAXED);
+        return fs->dflt;
+    };
+    __atomic_add_fetch(&fs->rules[r].hits, 1, __ATOMIC_RELAXED);
+    return fs->rules[r].accept;
+};
+
+// Should the packet 'payload' be recorded?  If the verdict for its sensor
+//   is cached, that's all; otherwise scan its JSON once, setting the bits
+//   of the conditions that hold, then take the first rule they match
+bool filterPacket(const char *payload) {
+    filterset_t *fs = __atomic_load_n(&filters, __ATOMIC_ACQUIRE);
+    char        key[FILTER_TEXT], val[FILTER_TEXT], sensorID[3*FILTER_TEXT];
+    const char *s = payload;
+    uint64_t    bits = 0, h = 14695981039346656037u, w;
+    bool        known;
+    int         f, r;
+
+    if ( (known = packetKey(payload, sensorID, sizeof(sensorID))) ) {
+        for (char *c = sensorID; *c; c++) h = (h ^ (uint8_t)*c) * 1099511628211u;
+        w = __atomic_load_n(&fs->cache[h % FILTER_CACHE], __ATOMIC_RELAXED);
+        if ( (w != 0) && (((w ^ h) & ~(uint64_t)0xff) == 0) ) {
+            __atomic_add_fetch(&fs->cacheHits, 1, __ATOMIC_RELAXED);
+            return verdict(fs, (int)(w & 0xff) - 1);
+        };
+    };
+
+    while (isspace((uint8_t)*s)) s++;
+    if (*s++ == '{')
+        while ( (s = scanPair(s, key, val)) != NULL )
+            if ( ((f = fieldFind(fs, key, false)) >= 0) && (f != fs->keyField) )
+                bits |= fieldBits(&fs->fields[f], val);
+    if (known && (fs->keyField >= 0)) bits |= fieldBits(&fs->fields[fs->keyField], sensorID);
+
+    for (r = 0; r < fs->nrules; r++)
+        if ( (bits & fs->rules[r].mask) == fs->rules[r].want ) break;
+    if ( known && ((r < fs->keyRules) || (fs->keyRules == fs->nrules)) )
+        __atomic_store_n(&fs->cache[h % FILTER_CACHE], (h & ~(uint64_t)0xff) | (r + 1), __ATOMIC_RELAXED);
+    return verdict(fs, r);
+};
+
+// List the rules, and the packets each has decided
+void filterPrint(void) {
+    filterset_t *fs = filters;
+    if ( (fs == NULL) || (fs->nrules == 0) ) return;
+    printf("Filter rules, and the packets each has decided:\n");
+    for (int r = 0; r < fs->nrules; r++)
+        printf("\t%-16s %s %10lu\n", fs->rules[r].name, fs->rules[r].accept ? "accept" : "reject",
+               __atomic_load_n(&fs->rules[r].hits, __ATOMIC_RELAXED));
+    printf("\t%-16s %s %10lu\n", "default", fs->dflt ? "accept" : "reject",
+           __atomic_load_n(&fs->dfltHits, __ATOMIC_RELAXED));
+    printf("\t%lu decided by the verdict cached for their sensor\n",
+           __atomic_load_n(&fs->cacheHits, __ATOMIC_RELAXED));
+};
@@ -0,0 +1,105 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_fresh.c
+    Freshness tracking for WDL_433, weather data logger for rtl_433
+
+    Measures the lag between the time rtl_433 received a sensor's
+    broadcast (the 'time' field of its JSON packet) and the time the
+    corresponding record was committed to the database.  Rolling
+    statistics are kept for each sensor (in its binary-tree node)
+    and overall.  Lags over the 'lagBudget' are counted and logged
+    when a sensor first goes over budget and when it recovers.
+
+    A sensor whose average lag differs from the overall average by
+    more than LAG_DRIFT seconds is likely heard by a receiver whose
+    clock has drifted (a negative lag means the receiver's clock is
+    ahead of ours).
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "WDL_433.h"
+
+extern bool   DEBUG;
+extern double lagBudget;
+extern NPTR   sensors;
+
+// Weight of the newest lag in the moving average
+#define LAG_ALPHA (1.0/16.0)
+
+lagstat_t lagAll;   // statistics over all sensors
+
+// Add one lag measurement to a set of statistics
+static void lagUpdate(lagstat_t *s, double lag) {
+    if (s->count == 0) {
+        s->avg = s->min = s->max = lag;
+    } else {
+        s->avg += LAG_ALPHA * (lag - s->avg);
+        if (lag < s->min) s->min = lag;
+        if (lag > s->max) s->max = lag;
+    };
+    s->last = lag;
+    s->count++;
+};
+
+// Note that 'DBRow' has just been committed and update the lag statistics
+void freshRecord(DBRecord *DBRow) {
+    struct timespec now;
+    double lag;
+    bool   over;
+    NPTR   node = DBRow->node;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    lag  = (double)(now.tv_sec - DBRow->rxtime) + now.tv_nsec / 1.0e9;
+    over = (lagBudget > 0) && (lag > lagBudget);
+
+    lagUpdate(&lagAll, lag);
+    if (over) lagAll.violations++;
+    if (node == NULL) return;
+
+    lagUpdate(&node->lag, lag);
+    if (over) {
+        node->lag.violations++;
+        if (!node->lag.over)
+            LOG(LM_FRESH, LV_WARN, "sensor %s lag %.1f sec exceeds budget of %.1f sec\n",
+                DBRow->sensorID, lag, lagBudget);
+    } else if (node->lag.over) {
+        LOG(LM_FRESH, LV_WARN, "sensor %s lag %.1f sec is back within budget\n",
+            DBRow->sensorID, lag);
+    };
+    node->lag.over = over;
+};
+
+// Print one line of lag statistics
+static void lagPrint(char *name, lagstat_t *s) {
+    printf("\t%-28s %7lu %8.1f %8.1f %8.1f %8.1f %6lu", name, s->count,
+           s->last, s->avg, s->min, s->max, s->violations);
+    if ( (s != &lagAll) && (lagAll.count > 0)
+         && (fabs(s->avg - lagAll.avg) > LAG_DRIFT) )
+        printf("  check receiver clock");
+    printf("\n");
+};
+
+// In-order printing of the lag statistics for sensors that have been recorded
+static void lagTreePrint(NPTR p) {
+    if (p != NULL) {
+        lagTreePrint(p->lptr);
+        if (p->lag.count > 0)
+            lagPrint( (p->alias == NULL) ? p->key : p->alias, &p->lag);
+        lagTreePrint(p->rptr);
+    };
+};
+
+void lagReport(void) {
+    printf("Receive-to-commit lag (sec), budget %.1f sec:\n", lagBudget);
+    printf("\t%-28s %7s %8s %8s %8s %8s %6s\n", "sensorID", "count",
+           "last", "avg", "min", "max", "over");
+    lagPrint("(all sensors)", &lagAll);
+    lagTreePrint(sensors);
+};
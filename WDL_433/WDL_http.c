@@ -0,0 +1,746 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_http.c
+    Chart-data service for WWW_433, from WDL_433, weather data logger
+    for rtl_433
+
+    If 'http' is set (e.g. '127.0.0.1:8433'), WDL_433 answers HTTP
+    requests for chart data, read from its sqlite3 database (sqlite3
+    must be the first, primary, backend, whose commits drive the ETags
+    and streams below), so the WWW_433 pages need only render the page
+    and fetch the data:
+        GET /chart?series=Deck:temp1,Deck:rh&hours=240&bin=300
+    series  comma-separated <sensorID or alias>:<field> pairs, where
+            <field> is temp1, temp2, rh, press or light (at most
+            CHART_SERIES)
+    hours   the range is the last 'hours' hours (default CHART_HOURS),
+            starting, with 'bin', with the first bin that covers it, or
+    from,to the range is from 'from' up to 'to' ('YYYY-mm-dd HH:MM:SS',
+            or any leading part of it)
+    bin     if > 0, readings are averaged over bins of 'bin' sec (or 'bin'
+            with s, m or h, e.g. 5m), labeled with the time the bin
+            starts; otherwise each reading is a row
+    points  if > 0, the rows are downsampled to about 'points' per
+            series (e.g. the chart's width in pixels), at most CHART_POINTS
+    since   the range is the readings after 'since' (sec from 1970, as
+            given by the last reply's "last"), for polling
+    The reply is JSON:
+        {"columns":["date_time","Deck:temp1","Deck:rh"],
+         "rows":[["2025-07-01 12:00:00",21.3,45],...]}
+    with null where a series has no reading in a row, and
+        "last":1751371500
+    the time of the latest reading in the reply (sec from 1970; 'since'
+    if there's none), to poll with.  Readings are stamped to the second,
+    and with 'bin' the first row of a poll may complete a bin the client
+    already has a row for.  A reply that isn't downsampled holds at
+    most HTTP_ROWS rows, the earliest in the range: to get the rest, ask
+    again with 'since' = its "last".  The request is parsed and the
+    reply written by WDL_chart.c, as for the views (WDL_views.c).
+
+    Each chart reply carries an ETag and Last-Modified made from what
+    WDL_433 has committed for the sensors in 'series' (counted in memory
+    as it commits them), and a request whose If-None-Match or
+    If-Modified-Since shows the client has the latest is answered 304
+    Not Modified by the main loop, without a query.  The ETag is weak:
+    a rolling range's reply isn't sent again just because old readings
+    have aged out of it.
+        GET /stream?sensors=Deck,Office
+    is a Server-Sent Events stream of the readings of those sensors
+    (sensorIDs or aliases, as recorded; all sensors if none are given),
+    each sent as it's committed to the database:
+        event: reading
+        data: {"date_time":"2025-07-01 12:05:00","sensor":"Deck",
+               "temp1":21.4,"temp2":0.0,"rh":45,"press":0.0,"light":0}
+    so a page can load the chart once and then add the new readings.
+
+    Connections are accepted and served by the main event loop; the
+    queries are run by a worker thread that keeps the database open
+    with one prepared statement per series, reused from request to
+    request.  The readings of each sensor come from the database in
+    time order (using the (sensorID, date_time) index the sqlite3
+    backend creates) and are merged and written as JSON in one pass.
+    Each connection is closed after its reply, or if the client takes
+    more than HTTP_TIMEOUT sec to send its request or to take the
+    reply, so slow or stalled clients can't use up the connections.  A
+    stream stays open: the readings are written to it by the main loop
+    as they're committed, with a comment every HTTP_PING sec to keep
+    proxies from closing it, so an idle stream costs only its socket.
+    A client that falls HTTP_BACKLOG bytes behind is disconnected.
+
+    Rows are downsampled (with Largest-Triangle-Three-Buckets, see
+    WDL_chart.c) as they're merged, so only two buckets' rows are held
+    at a time and the reply's size depends on 'points', not on the range.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sqlite3.h>
+
+#include "WDL_433.h"
+#include "WDL_chart.h"
+
+extern char *httpAddr;
+extern char *backend;
+extern char *sql3path;
+extern char *sql3file;
+
+#define HTTP_REQ_MAX  4096        // longest request header accepted
+#define HTTP_MAXCONN  64          // most chart requests at once
+#define HTTP_HEAD     384         // room for the reply's header
+#define HTTP_BUSY     2000        // msec to wait for a busy database
+#define HTTP_ROWS     100000      // most rows in a reply that isn't downsampled
+#define HTTP_STREAMS  1024        // most streams at once
+#define HTTP_BACKLOG  65536       // most bytes a stream may fall behind
+#define HTTP_PING     30          // sec between keep-alive comments on streams
+#define HTTP_TIMEOUT  10          // sec for a client to send its request, or take a reply
+
+typedef struct hconn {
+    int           fd;
+    char          req[HTTP_REQ_MAX];
+    size_t        reqLen;
+    char         *query;          // the request's query string, for the worker
+    hbuf_t        out;            // the reply
+    size_t        outPos;
+    bool          busy;           // with the worker
+    bool          gone;           // the client went away while busy
+    int           timer;          // closes it if the client is too slow; 0 if none
+    char         *sensors;        // a stream's ",sensor,...,", or NULL for all
+    char          etag[48];       // a chart's ETag
+    time_t        modified;       //   and Last-Modified
+    bool          stream;         // on the list of streams
+    struct hconn *next;
+} hconn_t;
+
+// The rows of one sensor, in time order
+typedef struct {
+    sqlite3_stmt *stmt;
+    bool          valid;          // 'stmt' is on a row
+    int64_t       key;            // the row's time, or bin
+    int           n;              // rows in the current output row
+    double        sum[AGG_FIELDS];
+} cursor_t;
+
+static int       listenFd = -1;
+static int       doneFd   = -1;   // eventfd: the worker has replies
+// What has been committed for each sensor, for conditional chart requests
+typedef struct {
+    char          sensor[sizeof(((DBRecord *)0)->sensorID)];
+    unsigned long version;        // readings committed since we started
+    time_t        modified;       // when the latest was committed
+} hsensor_t;
+
+static int       nconns   = 0;
+static int       nstreams = 0;
+static hconn_t  *streams  = NULL;
+static hsensor_t *hsensors = NULL;
+static int       nhsensors = 0;
+static time_t    started;         // when the versions started from 0
+static pthread_t worker;
+static pthread_mutex_t hLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  hCond = PTHREAD_COND_INITIALIZER;
+static hconn_t  *todo = NULL, *todoTail = NULL, *done = NULL;
+static bool      stopping = false;
+
+// Used only by the worker
+static sqlite3      *hdb = NULL;
+static sqlite3_stmt *hstmt[CHART_SERIES];
+static char          hpath[FNLEN+1];
+
+static void httpDbClose(void) {
+    for (int i = 0; i < CHART_SERIES; i++) {
+        sqlite3_finalize(hstmt[i]);
+        hstmt[i] = NULL;
+    };
+    sqlite3_close(hdb);
+    hdb = NULL;
+};
+
+// Open the database and prepare the statements, if they aren't already
+static bool httpDbOpen(void) {
+    if (hdb != NULL) return true;
+    snprintf(hpath, sizeof(hpath), "%s/%s", sql3path, sql3file);
+    if (sqlite3_open_v2(hpath, &hdb, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) goto fail;
+    sqlite3_busy_timeout(hdb, HTTP_BUSY);
+    for (int i = 0; i < CHART_SERIES; i++)
+        if (sqlite3_prepare_v2(hdb, "SELECT date_time, temp1, temp2, rh, press, light FROM "
+                               DBTABLE " WHERE sensorID = ?1 AND date_time >= ?2"
+                               " AND date_time < ?3 ORDER BY date_time",
+                               -1, &hstmt[i], NULL) != SQLITE_OK) goto fail;
+    return true;
+fail:
+    LOG(LM_HTTP, LV_ERR, "Can't read sqlite3 database '%s': %s\n", hpath, sqlite3_errmsg(hdb));
+    httpDbClose();
+    return false;
+};
+
+// Advance 'c' to its next row
+static void cursorStep(cursor_t *c, int bin) {
+    c->valid = (sqlite3_step(c->stmt) == SQLITE_ROW);
+    if (!c->valid) return;
+    c->key = dtSeconds((const char *)sqlite3_column_text(c->stmt, 0));
+    if (bin > 0) c->key = (c->key >= 0) ? c->key/bin : (c->key - bin + 1)/bin;
+};
+
+// Write the reply to the chart request 'query' into 'b'; returns the HTTP status
+static int httpChart(char *query, hbuf_t *b) {
+    chartreq_t  q;
+    cursor_t    cursors[CHART_SERIES];
+    int         cursor[CHART_SERIES];     // the cursor reading each series' sensor
+    int         ncursors = 0, f, status = 200;
+    char        from[24], latest[24] = "";
+    const char *to, *err;
+    int64_t     start, end, now = chartNow();
+    time_t      after;
+    struct tm   tm;
+    chart_t     chart;
+    hrow_t      row;
+
+    if ( (err = chartParse(query, &q)) != NULL ) {
+        bufAdd(b, "{\"error\":\"%s: use e.g. /chart?series=Deck:temp1,Deck:rh&hours=240&points=900\"}\n",
+               err);
+        return 400;
+    };
+    for (int s = 0; s < q.nseries; s++) {
+        cursor[s] = -1;
+        for (int i = 0; i < s; i++)
+            if (strcmp(q.sensor[i], q.sensor[s]) == 0) cursor[s] = cursor[i];
+        if (cursor[s] < 0) cursor[s] = ncursors++;
+    };
+    // The range: after 'since', from 'from', or rolling; it ends now at the latest
+    if (q.since >= 0) {
+        after = q.since + 1;
+        localtime_r(&after, &tm);
+        strftime(from, sizeof(from), "%Y-%m-%d %H:%M:%S", &tm);
+        start = dtSeconds(from);
+    } else if (q.from[0] != '\0') {
+        snprintf(from, sizeof(from), "%s", q.from);
+        start = dtSeconds(from);
+    } else {
+        start = chartStart(&q, now);
+        chartLabel(start, from);
+    };
+    to  = (q.to[0] != '\0') ? q.to : "9999";
+    end = ( (q.to[0] != '\0') && (dtSeconds(q.to) < now) ) ? dtSeconds(q.to) : now;
+    if (!httpDbOpen()) {
+        bufAdd(b, "{\"error\":\"database unavailable\"}\n");
+        return 503;
+    };
+
+    // One cursor per sensor, each on its first row
+    memset(cursors, 0, sizeof(cursors));
+    for (int s = 0; s < q.nseries; s++) {
+        cursor_t *c = &cursors[cursor[s]];
+        if (c->stmt != NULL) continue;
+        c->stmt = hstmt[cursor[s]];
+        sqlite3_bind_text(c->stmt, 1, q.sensor[s], -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(c->stmt, 2, from, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(c->stmt, 3, to,   -1, SQLITE_TRANSIENT);
+        cursorStep(c, q.bin);
+    };
+
+    // Merge the sensors' rows by time (or bin), up to HTTP_ROWS of them
+    //   if they aren't downsampled
+    chartBegin(&chart, b, &q, start, end);
+    for (;;) {
+        int64_t k = INT64_MAX;
+        if ( (q.points == 0) && (chart.written == HTTP_ROWS) ) break;
+        for (int c = 0; c < ncursors; c++)
+            if (cursors[c].valid && (cursors[c].key < k)) k = cursors[c].key;
+        if (k == INT64_MAX) break;
+        row.label[0] = '\0';
+        for (int c = 0; c < ncursors; c++) {
+            cursor_t *cu = &cursors[c];
+            cu->n = 0;
+            while (cu->valid && (cu->key == k)) {
+                const char *dt = (const char *)sqlite3_column_text(cu->stmt, 0);
+                if (row.label[0] == '\0') snprintf(row.label, sizeof(row.label), "%s", dt);
+                if (strcmp(dt, latest) > 0) snprintf(latest, sizeof(latest), "%s", dt);
+                for (f = 0; f < AGG_FIELDS; f++)
+                    cu->sum[f] = (cu->n == 0 ? 0 : cu->sum[f]) + sqlite3_column_double(cu->stmt, f+1);
+                cu->n++;
+                cursorStep(cu, q.bin);
+            };
+        };
+        row.t = (q.bin > 0) ? k*q.bin : k;
+        if (q.bin > 0) chartLabel(row.t, row.label);
+        for (int s = 0; s < q.nseries; s++) {
+            cursor_t *cu = &cursors[cursor[s]];
+            f = q.field[s];
+            row.has[s] = (cu->n > 0);
+            row.v[s]   = row.has[s] ? cu->sum[f]/cu->n : 0;
+        };
+        chartRow(&chart, &row);
+    };
+    chartEnd(&chart, latest, q.since);
+    for (int c = 0; c < ncursors; c++)
+        if (sqlite3_reset(cursors[c].stmt) != SQLITE_OK) status = 500;
+    if (status != 200) {
+        LOG(LM_HTTP, LV_WARN, "Error reading sqlite3 database '%s': %s\n", hpath, sqlite3_errmsg(hdb));
+        httpDbClose();
+        b->len = HTTP_HEAD;
+        bufAdd(b, "{\"error\":\"database error\"}\n");
+    };
+    return status;
+};
+
+static const char *httpReason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    default:  return "Service Unavailable";
+    };
+};
+
+// Put the header for 'status' in front of the reply body in 'c->out'
+static size_t httpHeader(hconn_t *c, int status) {
+    hbuf_t   *b = &c->out;
+    char      head[HTTP_HEAD], date[40];
+    struct tm tm;
+    size_t    len = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n", status, httpReason(status));
+    if (status != 304)
+        len += snprintf(head + len, sizeof(head) - len,
+                        "Content-Type: application/json\r\nContent-Length: %zu\r\n",
+                        b->len - HTTP_HEAD);
+    if ( (c->etag[0] != '\0') && ((status == 200) || (status == 304)) ) {
+        gmtime_r(&c->modified, &tm);
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        len += snprintf(head + len, sizeof(head) - len, "ETag: %s\r\nLast-Modified: %s\r\n",
+                        c->etag, date);
+    };
+    len += snprintf(head + len, sizeof(head) - len,
+                    "Cache-Control: no-cache\r\nConnection: close\r\n\r\n");
+    memcpy(b->s + HTTP_HEAD - len, head, len);
+    return HTTP_HEAD - len;
+};
+
+// A reply body, with room for its header in front
+static void httpBody(hbuf_t *b) {
+    b->s   = NULL;
+    b->len = b->max = 0;
+    bufAdd(b, "%*s", HTTP_HEAD, "");
+};
+
+static void *httpWorker(void *arg) {
+    hconn_t *c;
+    int      status;
+    uint64_t one = 1;
+    for (;;) {
+        pthread_mutex_lock(&hLock);
+        while ( (todo == NULL) && !stopping ) pthread_cond_wait(&hCond, &hLock);
+        if (stopping) {
+            pthread_mutex_unlock(&hLock);
+            break;
+        };
+        c = todo;
+        if ( (todo = c->next) == NULL ) todoTail = NULL;
+        pthread_mutex_unlock(&hLock);
+
+        httpBody(&c->out);
+        status   = httpChart(c->query, &c->out);
+        c->outPos = httpHeader(c, status);
+        LOG(LM_HTTP, LV_DEBUG, "Chart %d, %zu bytes\n", status, c->out.len - HTTP_HEAD);
+
+        pthread_mutex_lock(&hLock);
+        c->next = done;
+        done    = c;
+        pthread_mutex_unlock(&hLock);
+        if (write(doneFd, &one, sizeof(one)) < 0) {};
+    };
+    httpDbClose();
+    return NULL;
+};
+
+static void httpFree(hconn_t *c) {
+    if (c->timer != 0) evCancel(mainLoop, c->timer);
+    if (c->fd >= 0) {
+        evDelFd(mainLoop, c->fd);
+        close(c->fd);
+    };
+    if (c->stream) {
+        hconn_t **p;
+        for (p = &streams; *p != c; p = &(*p)->next) ;
+        *p = c->next;
+        nstreams--;
+    } else nconns--;
+    free(c->sensors);
+    free(c->out.s);
+    free(c);
+};
+
+// The client hasn't sent its request, or taken its reply, in time
+static void httpTimeout(void *arg) {
+    hconn_t *c = arg;
+    c->timer = 0;
+    LOG(LM_HTTP, LV_DEBUG, "Chart client too slow: disconnected\n");
+    httpFree(c);
+};
+
+// Send the reply, once it's ready
+static void httpSend(hconn_t *c) {
+    ssize_t n;
+    while (c->outPos < c->out.len) {
+        n = send(c->fd, c->out.s + c->outPos, c->out.len - c->outPos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                evModFd(mainLoop, c->fd, EPOLLOUT);
+                if (c->timer == 0) c->timer = evTimer(mainLoop, HTTP_TIMEOUT*1000, false, httpTimeout, c);
+                return;
+            };
+            break;
+        };
+        c->outPos += n;
+    };
+    httpFree(c);
+};
+
+// Send what's waiting on a stream; wait for room to send the rest
+static void streamSend(hconn_t *c) {
+    ssize_t n;
+    while (c->outPos < c->out.len) {
+        n = send(c->fd, c->out.s + c->outPos, c->out.len - c->outPos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                evModFd(mainLoop, c->fd, EPOLLIN | EPOLLOUT);
+                return;
+            };
+            httpFree(c);
+            return;
+        };
+        c->outPos += n;
+    };
+    c->out.len = c->outPos = 0;
+    evModFd(mainLoop, c->fd, EPOLLIN);
+};
+
+// Add an event to each stream that wants it ('sensor' NULL: to every stream)
+static void streamAdd(const char *sensor, const char *event) {
+    char     key[sizeof(((DBRecord *)0)->sensorID) + 2];
+    hconn_t *c, *next;
+    snprintf(key, sizeof(key), ",%s,", (sensor != NULL) ? sensor : "");
+    for (c = streams; c != NULL; c = next) {
+        next = c->next;
+        if ( (sensor != NULL) && (c->sensors != NULL) && (strstr(c->sensors, key) == NULL) ) continue;
+        if (c->out.len - c->outPos > HTTP_BACKLOG) {
+            LOG(LM_HTTP, LV_WARN, "Stream client too slow: disconnected\n");
+            httpFree(c);
+            continue;
+        };
+        bufAdd(&c->out, "%s", event);
+        if (c->out.len - strlen(event) == c->outPos) streamSend(c);
+    };
+};
+
+static void streamPing(void *arg) {
+    streamAdd(NULL, ": ping\n\n");
+};
+
+// Send a reading the primary backend has committed to the streams
+void httpRecord(DBRecord *DBRow) {
+    char   event[512];
+    double v[AGG_FIELDS] = { DBRow->temp1, DBRow->temp2, DBRow->rh, DBRow->press, DBRow->light };
+    size_t len;
+    int    i;
+    if (listenFd < 0) return;
+    for (i = 0; i < nhsensors; i++)
+        if (strcmp(hsensors[i].sensor, DBRow->sensorID) == 0) break;
+    if (i == nhsensors) {
+        if ( (hsensors = realloc(hsensors, (nhsensors+1)*sizeof(hsensor_t))) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for chart data\n");
+            exit(EXIT_FAILURE);
+        };
+        memset(&hsensors[i], 0, sizeof(hsensor_t));
+        snprintf(hsensors[i].sensor, sizeof(hsensors[i].sensor), "%s", DBRow->sensorID);
+        nhsensors++;
+    };
+    hsensors[i].version++;
+    hsensors[i].modified = time(NULL);
+    if (streams == NULL) return;
+    len = snprintf(event, sizeof(event), "event: reading\ndata: {\"date_time\":\"%s\",\"sensor\":\"",
+                   DBRow->date_time);
+    for (char *s = DBRow->sensorID; (*s != '\0') && (len < sizeof(event) - 8); s++)
+        if ( (*s == '"') || (*s == '\\') ) len += snprintf(event + len, sizeof(event) - len, "\\%c", *s);
+        else if ((unsigned char)*s >= ' ') event[len++] = *s;
+    len += snprintf(event + len, sizeof(event) - len, "\"");
+    for (int f = 0; f < AGG_FIELDS; f++)
+        len += snprintf(event + len, sizeof(event) - len, ",\"%s\":%.*f", aggFields[f], aggDigits[f], v[f]);
+    snprintf(event + len, sizeof(event) - len, "}\n\n");
+    streamAdd(DBRow->sensorID, event);
+};
+
+// Reply to a request the main thread can answer itself
+static void httpError(hconn_t *c, int status) {
+    httpBody(&c->out);
+    if (status != 304) bufAdd(&c->out, "{\"error\":\"%s\"}\n", httpReason(status));
+    c->outPos = httpHeader(c, status);
+    httpSend(c);
+};
+
+// Turn the connection into a stream of the sensors in 'query'
+static void streamStart(hconn_t *c, char *query) {
+    char *key, *val, *save;
+    if (nstreams == HTTP_STREAMS) {
+        LOG(LM_HTTP, LV_WARN, "Too many streams: one refused\n");
+        httpError(c, 503);
+        return;
+    };
+    for (key = strtok_r(query, "&", &save); key != NULL; key = strtok_r(NULL, "&", &save)) {
+        if ( (val = strchr(key, '=')) == NULL ) continue;
+        *val++ = '\0';
+        urlDecode(val);
+        if ( (strcmp(key, "sensors") == 0) && (*val != '\0') ) {
+            free(c->sensors);
+            if ( (c->sensors = malloc(strlen(val) + 3)) == NULL ) {
+                httpError(c, 503);
+                return;
+            };
+            sprintf(c->sensors, ",%s,", val);
+        };
+    };
+    nconns--;
+    nstreams++;
+    c->stream  = true;
+    c->next    = streams;
+    streams    = c;
+    c->reqLen  = 0;
+    c->out.len = c->outPos = 0;
+    bufAdd(&c->out, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+           "Cache-Control: no-cache\r\nX-Accel-Buffering: no\r\nConnection: close\r\n\r\n"
+           "retry: 10000\n\n");
+    streamSend(c);
+};
+
+// The ETag and Last-Modified of the chart 'c' asks for, from the versions
+//   of the sensors in its 'series'
+static void httpVersion(hconn_t *c) {
+    char         *query = strdup(c->query);
+    chartreq_t    q;
+    unsigned long version = 0;
+    c->modified = started;
+    if ( (query != NULL) && (chartParse(query, &q) == NULL) )
+        for (int s = 0; s < q.nseries; s++)
+            for (int i = 0; i < nhsensors; i++)
+                if (strcmp(hsensors[i].sensor, q.sensor[s]) == 0) {
+                    version += hsensors[i].version;
+                    if (hsensors[i].modified > c->modified) c->modified = hsensors[i].modified;
+                };
+    free(query);
+    snprintf(c->etag, sizeof(c->etag), "W/\"%lx-%lu\"", (unsigned long)started, version);
+};
+
+// Does the client already have the chart?  'head' is the request's
+//   header lines
+static bool httpFresh(hconn_t *c, char *head) {
+    char     *h, value[80];
+    struct tm tm;
+    if ( (h = strcasestr(head, "\nIf-None-Match:")) != NULL ) {
+        sscanf(h + 15, " %79[^\r\n]", value);
+        return (strstr(value, c->etag) != NULL) || (strcmp(value, "*") == 0);
+    };
+    if ( (h = strcasestr(head, "\nIf-Modified-Since:")) != NULL ) {
+        memset(&tm, 0, sizeof(tm));
+        if (strptime(h + 19, " %a, %d %b %Y %H:%M:%S GMT", &tm) != NULL)
+            return timegm(&tm) >= c->modified;
+    };
+    return false;
+};
+
+// A complete request header has arrived: hand chart requests to the worker
+static void httpRequest(hconn_t *c) {
+    char *path, *end, *head = "";
+    evCancel(mainLoop, c->timer);
+    c->timer = 0;
+    if (strncmp(c->req, "GET ", 4) != 0) {
+        httpError(c, 405);
+        return;
+    };
+    path = c->req + 4;
+    if ( (end = strpbrk(path, " \r\n")) != NULL ) {
+        *end = '\0';
+        head = end + 1;
+    };
+    if ( (c->query = strchr(path, '?')) != NULL ) *c->query++ = '\0';
+    else c->query = path + strlen(path);
+    if (strcmp(path, "/stream") == 0) {
+        streamStart(c, c->query);
+        return;
+    };
+    if (strcmp(path, "/chart") != 0) {
+        httpError(c, 404);
+        return;
+    };
+    httpVersion(c);
+    if (httpFresh(c, head)) {
+        httpError(c, 304);
+        return;
+    };
+    if (nconns > HTTP_MAXCONN) {
+        LOG(LM_HTTP, LV_WARN, "Too many chart requests: one refused\n");
+        httpError(c, 503);
+        return;
+    };
+    c->busy = true;
+    evModFd(mainLoop, c->fd, 0);
+    pthread_mutex_lock(&hLock);
+    c->next = NULL;
+    if (todoTail != NULL) todoTail->next = c;
+    else                  todo = c;
+    todoTail = c;
+    pthread_cond_signal(&hCond);
+    pthread_mutex_unlock(&hLock);
+};
+
+static void httpEvent(int fd, uint32_t events, void *arg) {
+    hconn_t *c = arg;
+    ssize_t  n;
+    if (c->busy) {
+        // The connection failed: forget it when the worker is done with it
+        evDelFd(mainLoop, c->fd);
+        close(c->fd);
+        c->fd   = -1;
+        c->gone = true;
+        return;
+    };
+    if (c->stream) {
+        // Nothing more is expected from the client but its going away
+        if (events & EPOLLOUT) {
+            streamSend(c);
+            return;
+        };
+        n = read(fd, c->req, sizeof(c->req));
+        if ( (n == 0) || ((n < 0) && (errno != EAGAIN)) ) httpFree(c);
+        return;
+    };
+    if (events & EPOLLOUT) {
+        httpSend(c);
+        return;
+    };
+    n = read(fd, c->req + c->reqLen, sizeof(c->req) - 1 - c->reqLen);
+    if (n <= 0) {
+        if ( (n < 0) && (errno == EAGAIN) ) return;
+        httpFree(c);
+        return;
+    };
+    c->reqLen += n;
+    c->req[c->reqLen] = '\0';
+    if (strstr(c->req, "\r\n\r\n") != NULL || strstr(c->req, "\n\n") != NULL)
+        httpRequest(c);
+    else if (c->reqLen == sizeof(c->req) - 1)
+        httpError(c, 431);
+};
+
+// The worker has replies: send them
+static void httpDone(int fd, uint32_t events, void *arg) {
+    uint64_t n;
+    hconn_t *c, *next;
+    if (read(fd, &n, sizeof(n)) < 0) {};
+    pthread_mutex_lock(&hLock);
+    c    = done;
+    done = NULL;
+    pthread_mutex_unlock(&hLock);
+    for (; c != NULL; c = next) {
+        next    = c->next;
+        c->busy = false;
+        if (c->gone) httpFree(c);
+        else         httpSend(c);
+    };
+};
+
+static void httpAccept(int fd, uint32_t events, void *arg) {
+    hconn_t *c;
+    int      cfd;
+    while ( (cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0 ) {
+        if ( (nconns + nstreams >= HTTP_MAXCONN + HTTP_STREAMS)
+             || ((c = calloc(1, sizeof(hconn_t))) == NULL) ) {
+            LOG(LM_HTTP, LV_WARN, "Too many chart connections: one refused\n");
+            close(cfd);
+            continue;
+        };
+        c->fd    = cfd;
+        c->timer = evTimer(mainLoop, HTTP_TIMEOUT*1000, false, httpTimeout, c);
+        nconns++;
+        evAddFd(mainLoop, cfd, EPOLLIN, httpEvent, c);
+    };
+};
+
+// Listen for chart requests on 'http' ([address:]port)
+void httpOpen(void) {
+    struct addrinfo hints, *res;
+    char  *addr, *port;
+    int    on = 1, rc;
+
+    if ( (httpAddr == NULL) || (*httpAddr == '\0') ) return;
+    if (!storePrimary("sqlite3")) {
+        fprintf(stderr, "?WDL_433: chart data ('http') is read from the sqlite3 database: "
+                "list sqlite3 first in 'backend' (now '%s')\n", backend);
+        exit(EXIT_FAILURE);
+    };
+    addr = strdup(httpAddr);
+    if ( (port = strrchr(addr, ':')) != NULL ) *port++ = '\0';
+    else {
+        port = addr;
+        addr = "";
+    };
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    if ( (rc = getaddrinfo((*addr != '\0') ? addr : NULL, port, &hints, &res)) != 0 ) {
+        fprintf(stderr, "?WDL_433: invalid 'http' address '%s': %s\n", httpAddr, gai_strerror(rc));
+        exit(EXIT_FAILURE);
+    };
+    listenFd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd >= 0) setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ( (listenFd < 0) || (bind(listenFd, res->ai_addr, res->ai_addrlen) != 0)
+         || (listen(listenFd, SOMAXCONN) != 0) ) {
+        fprintf(stderr, "?WDL_433: can't listen for chart requests on '%s': %s\n",
+                httpAddr, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    freeaddrinfo(res);
+    doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ( (doneFd < 0) || !evAddFd(mainLoop, listenFd, EPOLLIN, httpAccept, NULL)
+         || !evAddFd(mainLoop, doneFd, EPOLLIN, httpDone, NULL)
+         || (pthread_create(&worker, NULL, httpWorker, NULL) != 0) ) {
+        fprintf(stderr, "?WDL_433: can't start the chart service\n");
+        exit(EXIT_FAILURE);
+    };
+    started = time(NULL);
+    evTimer(mainLoop, HTTP_PING*1000, true, streamPing, NULL);
+    LOG(LM_HTTP, LV_INFO, "Serving chart data on '%s'\n", httpAddr);
+};
+
+void httpClose(void) {
+    if (listenFd < 0) return;
+    pthread_mutex_lock(&hLock);
+    stopping = true;
+    pthread_cond_signal(&hCond);
+    pthread_mutex_unlock(&hLock);
+    pthread_join(worker, NULL);
+    while (streams != NULL) httpFree(streams);
+    free(hsensors);
+    hsensors  = NULL;
+    nhsensors = 0;
+    evDelFd(mainLoop, listenFd);
+    evDelFd(mainLoop, doneFd);
+    close(listenFd);
+    close(doneFd);
+    listenFd = doneFd = -1;
+};
@@ -0,0 +1,413 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_import.c
+    Bulk import of historical packets for WDL_433, weather data logger
+    for rtl_433
+
+        WDL_433 [options] --import <file> ...
+
+    loads the packets in the files (logs written by 'rtl_433 -F json',
+    gzipped or not, or WDL_433 capture segments, *.wcap) into the
+    database, by the same alias, de-duplication and recording-interval
+    rules as packets received live, then exits.
+
+    The files are parsed in parallel, each by one of a pool of worker
+    threads (one per processor), into an array of records sorted by
+    time.  The main thread merges those arrays in time order and
+    applies the rules.  So that it doesn't need every file in memory
+    at once, the files are ordered by the time of their earliest packet
+    (found by a first pass over the files, also in parallel, that reads
+    only each packet's "time": a log isn't always in time order, and a
+    record merged after later ones would be dropped by the recording
+    interval), a file is merged only once the merge has reached that
+    time, and workers parse at most IMPORT_AHEAD files per worker ahead
+    of the merge.
+
+    Records go to the storage sinks in 'bulk' mode: no spool (a record
+    the database won't take stops the import), batches of up to
+    IMPORT_BATCH records, and backend-specific shortcuts (see
+    WDL_sqlite.c).  Parsing waits while more than IMPORT_BACKLOG
+    records are waiting for any sink.  The sensor registry is not
+    restored or saved, so the import doesn't disturb a running
+    WDL_433's recording intervals.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "WDL_433.h"
+
+extern char *spoolFile;
+extern bool  bulkLoad;
+
+#define IMPORT_LINE    8192       // longest packet line
+#define IMPORT_AHEAD   2          // files parsed ahead of the merge, per worker
+#define IMPORT_BACKLOG (4*IMPORT_BATCH)
+#define IMPORT_REPORT  5          // sec between progress reports
+
+// A file's records, as parsed
+typedef struct {
+    char     *path;
+    time_t    first;              // time of its earliest packet
+    DBRecord *rows;
+    long      count, max, next;
+    long      packets, errors;
+    int       state;              // IMP_WAITING, IMP_PARSING, IMP_READY, IMP_DONE
+} ifile_t;
+
+enum {IMP_WAITING, IMP_PARSING, IMP_READY, IMP_DONE};
+
+// A source of packet lines: a text log (through zlib, so it may be gzipped)
+//   or a capture segment
+typedef struct {
+    gzFile  gz;
+    int     fd;
+    bool    cap;
+    char   *raw;                  // decompressed capture block
+    size_t  rawLen, pos, rawMax;
+    Bytef  *z;
+    size_t  zMax;
+} reader_t;
+
+static ifile_t        *files;
+static int             nfiles;
+static int             nextJob = 0;   // next file for a worker to parse
+static int             started = 0;   // files the merge has started on
+static int             merged  = 0;   // files the merge has finished with
+static int             ahead;
+static pthread_mutex_t impLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  impCond = PTHREAD_COND_INITIALIZER;
+
+static bool isCapture(const char *path) {
+    size_t len = strlen(path);
+    return (len > 5) && (strcmp(path + len - 5, ".wcap") == 0);
+};
+
+static bool readerOpen(reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->cap = isCapture(path);
+    if (r->cap) {
+        r->fd = open(path, O_RDONLY|O_CLOEXEC);
+        return r->fd >= 0;
+    };
+    r->gz = gzopen(path, "rb");
+    if (r->gz != NULL) gzbuffer(r->gz, 256*1024);
+    return r->gz != NULL;
+};
+
+static void readerClose(reader_t *r) {
+    if (r->cap) close(r->fd);
+    else        gzclose(r->gz);
+    free(r->raw);
+    free(r->z);
+};
+
+// Read and decompress the next capture block; false at the end or on error
+static bool readerBlock(reader_t *r, const char *path) {
+    capBlock hdr;
+    uLongf   len;
+    ssize_t  n = read(r->fd, &hdr, sizeof(hdr));
+    if (n == 0) return false;
+    if ( (n != sizeof(hdr)) || (hdr.magic != CAP_MAGIC) ) {
+        LOG(LM_MAIN, LV_WARN, "'%s' is truncated or not a capture segment\n", path);
+        return false;
+    };
+    if (hdr.zLen > r->zMax) r->z = realloc(r->z, r->zMax = hdr.zLen);
+    if (hdr.rawLen > r->rawMax) r->raw = realloc(r->raw, r->rawMax = hdr.rawLen);
+    len = hdr.rawLen;
+    if ( (r->z == NULL) || (r->raw == NULL) || (read(r->fd, r->z, hdr.zLen) != (ssize_t)hdr.zLen)
+         || (uncompress((Bytef *)r->raw, &len, r->z, hdr.zLen) != Z_OK)
+         || (len != hdr.rawLen) || (crc32(0, (Bytef *)r->raw, len) != hdr.crc) ) {
+        LOG(LM_MAIN, LV_WARN, "Damaged block in capture segment '%s'\n", path);
+        return false;
+    };
+    r->rawLen = len;
+    r->pos    = 0;
+    return true;
+};
+
+// Copy the next packet line into 'buf'; false at the end of the file
+static bool readerLine(reader_t *r, const char *path, char *buf, int size) {
+    char *nl, *tab;
+    size_t len;
+    if (!r->cap) {
+        if (gzgets(r->gz, buf, size) == NULL) return false;
+        len = strlen(buf);
+        if ( (len == (size_t)size-1) && (buf[len-1] != '\n') ) {
+            // Too long to be a packet: skip the rest of it
+            int c;
+            while ( ((c = gzgetc(r->gz)) != -1) && (c != '\n') ) {};
+            buf[0] = '\0';
+        };
+        return true;
+    };
+    if ( (r->pos >= r->rawLen) && !readerBlock(r, path) ) return false;
+    nl  = memchr(r->raw + r->pos, '\n', r->rawLen - r->pos);
+    len = (nl == NULL) ? r->rawLen - r->pos : (size_t)(nl - (r->raw + r->pos));
+    if (len >= (size_t)size) len = 0;
+    memcpy(buf, r->raw + r->pos, len);
+    buf[len] = '\0';
+    r->pos += len + 1;
+    // Drop the receive time that precedes the packet
+    if ( (tab = strchr(buf, '\t')) != NULL ) memmove(buf, tab+1, strlen(tab+1)+1);
+    return true;
+};
+
+// Parse the next packet we might record from 'r' into 'row'
+static bool readerPacket(reader_t *r, ifile_t *f, char *buf, DBRecord *row) {
+    while (readerLine(r, f->path, buf, IMPORT_LINE)) {
+        char *json = strchr(buf, '{');
+        if ( (json == NULL) || !wantMessage(json) ) continue;
+        f->packets++;
+        if (parseMessage(json, row)) return true;
+        f->errors++;
+    };
+    return false;
+};
+
+static int rowCompare(const void *a, const void *b) {
+    time_t ta = ((DBRecord *)a)->rxtime, tb = ((DBRecord *)b)->rxtime;
+    return (ta < tb) ? -1 : (ta > tb);
+};
+
+// Parse a whole file into f->rows, sorted by time
+static void importParse(ifile_t *f) {
+    char     buf[IMPORT_LINE];
+    reader_t r;
+    if (!readerOpen(&r, f->path)) {
+        LOG(LM_MAIN, LV_ERR, "Can't read '%s': %s\n", f->path, strerror(errno));
+        return;
+    };
+    for (;;) {
+        if (f->count == f->max) {
+            f->max  = (f->max == 0) ? 4096 : 2*f->max;
+            f->rows = realloc(f->rows, f->max*sizeof(DBRecord));
+            if (f->rows == NULL) {
+                fprintf(stderr, "?WDL_433: out of memory importing '%s'\n", f->path);
+                exit(EXIT_FAILURE);
+            };
+        };
+        if (!readerPacket(&r, f, buf, &f->rows[f->count])) break;
+        f->count++;
+    };
+    readerClose(&r);
+    // A log from one receiver is almost in order already
+    qsort(f->rows, f->count, sizeof(DBRecord), rowCompare);
+};
+
+// Worker: parse files in order, at most 'ahead' files beyond those being merged
+static void *importWorker(void *arg) {
+    ifile_t *f;
+    pthread_mutex_lock(&impLock);
+    for (;;) {
+        while ( (nextJob < nfiles) && (nextJob >= started + ahead) )
+            pthread_cond_wait(&impCond, &impLock);
+        if (nextJob >= nfiles) break;
+        f = &files[nextJob++];
+        f->state = IMP_PARSING;
+        pthread_mutex_unlock(&impLock);
+        importParse(f);
+        pthread_mutex_lock(&impLock);
+        f->state = IMP_READY;
+        pthread_cond_broadcast(&impCond);
+    };
+    pthread_mutex_unlock(&impLock);
+    return NULL;
+};
+
+static int fileCompare(const void *a, const void *b) {
+    time_t ta = ((ifile_t *)a)->first, tb = ((ifile_t *)b)->first;
+    return (ta < tb) ? -1 : (ta > tb);
+};
+
+// The time of the packet 'json', from its "time" alone (without a full
+//   parse, as importParse() will do that); false if it has none
+static bool packetTime(const char *json, time_t *t) {
+    const char *s = json;
+    struct tm   tm;
+    while ( (s = strstr(s, "\"time\"")) != NULL ) {
+        for (s += 6; (*s == ' ') || (*s == '\t'); s++) {};
+        if (*s != ':') continue;
+        for (s++; (*s == ' ') || (*s == '\t'); s++) {};
+        if (*s++ != '"') return false;
+        memset(&tm, 0, sizeof(tm));
+        if (strptime(s, "%Y-%m-%d %H:%M:%S", &tm) == NULL) return false;
+        tm.tm_isdst = -1;
+        *t = mktime(&tm);
+        return true;
+    };
+    return false;
+};
+
+// Time of a file's earliest packet, for ordering the files.  Packets that
+//   won't be recorded count too: that only starts the file's merge early
+static time_t importFirst(ifile_t *f) {
+    char     buf[IMPORT_LINE];
+    reader_t r;
+    time_t   t = (time_t)INT64_MAX, pt;
+    if (!readerOpen(&r, f->path)) {
+        fprintf(stderr, "?WDL_433: can't read '%s': %s\n", f->path, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    while (readerLine(&r, f->path, buf, IMPORT_LINE)) {
+        char *json = strchr(buf, '{');
+        if ( (json != NULL) && packetTime(json, &pt) && (pt < t) ) t = pt;
+    };
+    readerClose(&r);
+    return t;
+};
+
+// Worker: find the earliest packet of each file not yet scanned
+static void *importScan(void *arg) {
+    int i;
+    while ( (i = __atomic_fetch_add(&nextJob, 1, __ATOMIC_RELAXED)) < nfiles )
+        files[i].first = importFirst(&files[i]);
+    return NULL;
+};
+
+// Wait for file 'i' to be parsed
+static void importWait(int i) {
+    pthread_mutex_lock(&impLock);
+    started = i+1;
+    pthread_cond_broadcast(&impCond);
+    while (files[i].state != IMP_READY) pthread_cond_wait(&impCond, &impLock);
+    pthread_mutex_unlock(&impLock);
+};
+
+// Done with file 'i': free its records
+static void importDone(int i) {
+    ifile_t *f = &files[i];
+    free(f->rows);
+    f->rows  = NULL;
+    f->state = IMP_DONE;
+    merged++;
+};
+
+static double elapsed(struct timespec *t0) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec)/1e9;
+};
+
+// Import the packets in 'paths' and exit
+void importFiles(int n, char **paths) {
+    pthread_t *workers;
+    int       *active, nactive = 0, nextFile = 0, nworkers, best;
+    long       packets = 0, errors = 0;
+    unsigned long count = 0, lastCount = 0;     // packets merged
+    double     t, lastReport = 0;
+    struct timespec t0, zero = {0, 0};
+    sigset_t   stop;
+
+    if (n == 0) {
+        fprintf(stderr, "?WDL_433: --import needs the names of the files to import\n");
+        exit(EXIT_FAILURE);
+    };
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+
+    // Order the files by the time of their earliest packet
+    nfiles = n;
+    files  = calloc(n, sizeof(ifile_t));
+    active = calloc(n, sizeof(int));
+    for (int i = 0; i < n; i++) files[i].path = paths[i];
+    nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) nworkers = 1;
+    if (nworkers > n) nworkers = n;
+    workers = calloc(nworkers, sizeof(pthread_t));
+    for (int i = 0; i < nworkers; i++)
+        pthread_create(&workers[i], NULL, importScan, NULL);
+    for (int i = 0; i < nworkers; i++) pthread_join(workers[i], NULL);
+    nextJob = 0;
+    qsort(files, n, sizeof(ifile_t), fileCompare);
+
+    // Open the database in bulk mode, without a spool
+    bulkLoad  = true;
+    spoolFile = "";
+    storeInit();
+    storeStart();
+
+    ahead = IMPORT_AHEAD*nworkers;
+    for (int i = 0; i < nworkers; i++)
+        pthread_create(&workers[i], NULL, importWorker, NULL);
+    LOG(LM_MAIN, LV_INFO, "Importing %d files with %d parsing threads\n", n, nworkers);
+
+    // Merge the files' records in time order
+    for (;;) {
+        // The earliest record not yet merged, in the files being merged
+        best = -1;
+        for (int i = 0; i < nactive; i++) {
+            ifile_t *f = &files[active[i]];
+            if ( (best < 0) || (f->rows[f->next].rxtime < files[active[best]].rows[files[active[best]].next].rxtime) )
+                best = i;
+        };
+        // Start merging the next file if it begins before that record
+        if ( (nextFile < n) && (files[nextFile].first != (time_t)INT64_MAX)
+             && ( (best < 0)
+                  || (files[nextFile].first <= files[active[best]].rows[files[active[best]].next].rxtime) ) ) {
+            importWait(nextFile);
+            packets += files[nextFile].packets;
+            errors  += files[nextFile].errors;
+            if (files[nextFile].count > 0) active[nactive++] = nextFile;
+            else                           importDone(nextFile);
+            nextFile++;
+            continue;
+        };
+        if (best < 0) break;
+
+        ifile_t *f = &files[active[best]];
+        recordMessage(&f->rows[f->next]);
+        if (++f->next == f->count) {
+            importDone(active[best]);
+            active[best] = active[--nactive];
+        };
+
+        // Report progress, let the sinks catch up, and stop if told to
+        if ( (++count & 0xfff) == 0 ) {
+            while (storeBacklog() > IMPORT_BACKLOG) usleep(1000);
+            if (sigtimedwait(&stop, NULL, &zero) > 0) {
+                LOG(LM_MAIN, LV_WARN, "Import interrupted\n");
+                break;
+            };
+            t = elapsed(&t0);
+            if (t - lastReport >= IMPORT_REPORT) {
+                LOG(LM_MAIN, LV_INFO, "Import: %d of %d files, %lu packets merged, "
+                    "%lu/sec; %lu rows recorded\n", merged, n, count,
+                    (unsigned long)((count - lastCount)/(t - lastReport)), storeCount());
+                lastReport = t;
+                lastCount  = count;
+            };
+        };
+    };
+
+    // Let the workers finish (or stop) and the sinks commit what they have
+    pthread_mutex_lock(&impLock);
+    nextJob = nfiles;
+    pthread_cond_broadcast(&impCond);
+    pthread_mutex_unlock(&impLock);
+    for (int i = 0; i < nworkers; i++) pthread_join(workers[i], NULL);
+    policyClose();
+    storeClose();
+    for (int i = 0; i < n; i++) free(files[i].rows);
+    t = elapsed(&t0);
+    LOG(LM_MAIN, LV_INFO, "Imported %d files in %.1f sec: %ld packets (%ld unreadable), "
+        "%lu rows recorded, %.0f packets/sec\n", n, t, packets, errors, storeCount(),
+        count/((t > 0) ? t : 1));
+    free(workers);
+    free(active);
+    free(files);
+};
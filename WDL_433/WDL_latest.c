@@ -0,0 +1,111 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_latest.c
+    "Latest readings" table in shared memory for WDL_433, weather data
+    logger for rtl_433
+
+    If 'latest' is set (e.g. '/WDL_433'), WDL_433 keeps the latest
+    reading of each sensor, as committed to the database, in a POSIX
+    shared-memory object of that name (see WDL_latest.h for its layout),
+    so a page's current conditions can be read in microseconds without
+    a query: by WDL_now, a CGI, or PHP through FFI.  The object is left
+    in place when WDL_433 stops, so readers keep the last readings, and
+    its entries are taken up again when WDL_433 restarts.  A sensor not
+    heard from for LATEST_STALE sec gives up its entry to a new sensor
+    once the table is full.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "WDL_433.h"
+#include "WDL_latest.h"
+
+extern char *latestName;
+
+static latestTable *table = NULL;
+static bool         full  = false;  // the table is full: warned once
+
+void latestOpen(void) {
+    int fd;
+    if ( (latestName == NULL) || (*latestName == '\0') ) return;
+    if ( (fd = shm_open(latestName, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ) {
+        fprintf(stderr, "?WDL_433: can't create shared memory '%s': %s\n", latestName, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    if ( (ftruncate(fd, sizeof(latestTable)) != 0)
+         || ((table = mmap(NULL, sizeof(latestTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+             == MAP_FAILED) ) {
+        fprintf(stderr, "?WDL_433: can't map shared memory '%s': %s\n", latestName, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    close(fd);
+    // Keep the entries of a table we left, otherwise start a new one
+    if ( (table->magic != LATEST_MAGIC) || (table->version != LATEST_VERSION)
+         || (table->size != sizeof(latestTable)) || (table->count > LATEST_SENSORS) ) {
+        memset(table, 0, sizeof(latestTable));
+        table->version = LATEST_VERSION;
+        table->size    = sizeof(latestTable);
+        __atomic_store_n(&table->magic, LATEST_MAGIC, __ATOMIC_RELEASE);
+    };
+    // An entry left odd (we stopped while writing it) would hold off its
+    //   readers for good: its count is made even, marking a change
+    for (uint32_t i = 0; i < table->count; i++)
+        if (table->entry[i].seq & 1)
+            __atomic_store_n(&table->entry[i].seq, table->entry[i].seq + 1, __ATOMIC_RELEASE);
+    LOG(LM_MAIN, LV_DEBUG, "Latest readings in shared memory '%s', %u sensors\n",
+        latestName, table->count);
+};
+
+// Put a record the primary backend has committed in the table
+void latestRecord(DBRecord *DBRow) {
+    latestEntry *e;
+    uint32_t     i, j, n;
+    if (table == NULL) return;
+    n = table->count;
+    for (i = 0; i < n; i++)
+        if (strcmp(table->entry[i].sensor, DBRow->sensorID) == 0) break;
+    if (i == LATEST_SENSORS) {
+        // Full: take over the entry written longest ago, if it's stale
+        for (i = 0, j = 1; j < n; j++)
+            if (table->entry[j].rxtime < table->entry[i].rxtime) i = j;
+        if (time(NULL) - table->entry[i].rxtime < LATEST_STALE) {
+            if (!full) LOG(LM_MAIN, LV_WARN, "Shared memory '%s' is full: %d sensors\n",
+                           latestName, LATEST_SENSORS);
+            full = true;
+            return;
+        };
+        LOG(LM_MAIN, LV_DEBUG, "Shared memory '%s': '%s' takes the entry of '%s', last read %s\n",
+            latestName, DBRow->sensorID, table->entry[i].sensor, table->entry[i].date_time);
+    };
+    e = &table->entry[i];
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snprintf(e->sensor, sizeof(e->sensor), "%s", DBRow->sensorID);
+    snprintf(e->date_time, sizeof(e->date_time), "%s", DBRow->date_time);
+    e->rxtime   = DBRow->rxtime;
+    e->value[0] = DBRow->temp1;
+    e->value[1] = DBRow->temp2;
+    e->value[2] = DBRow->rh;
+    e->value[3] = DBRow->press;
+    e->value[4] = DBRow->light;
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+    if (i == n) __atomic_store_n(&table->count, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->updated, (int64_t)time(NULL), __ATOMIC_RELAXED);
+};
+
+void latestClose(void) {
+    if (table == NULL) return;
+    munmap(table, sizeof(latestTable));
+    table = NULL;
+};
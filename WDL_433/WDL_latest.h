@@ -0,0 +1,73 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_latest.h
+    Layout of the "latest readings" table that WDL_433, weather data
+    logger for rtl_433, keeps in POSIX shared memory (the 'latest'
+    setting, e.g. '/WDL_433'), for WDL_433 and the programs that read
+    it: WDL_now, a CGI, or PHP through FFI.
+
+    The table has an entry for each sensor WDL_433 has recorded, named
+    as it's recorded (by alias, if it has one), holding the latest
+    reading committed to the database.  WDL_433 is the only writer;
+    each entry is guarded by a sequence count that is odd while the
+    entry is being written, so readers take no lock: they copy the
+    entry and try again if the count was odd or has changed
+    (latestRead()); a reader gives up on an entry left odd by a writer
+    that died, and WDL_433 makes every count even when it takes the
+    table up again.  'count' is raised only once a new entry is
+    written.  Once the table is full, a new sensor takes over the entry
+    written longest ago, if that's more than LATEST_STALE sec ago, so
+    the table keeps up as sensors come and go (a reader finding a
+    sensor by name must check the name of the entry it copied).
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#ifndef WDL_LATEST_H
+#define WDL_LATEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define LATEST_MAGIC    0x5441574cU     // "LWAT"
+#define LATEST_VERSION  2
+#define LATEST_SENSORS  256             // most sensors in the table
+#define LATEST_STALE    (24*60*60)      // sec before an entry may be taken over
+#define LATEST_TRIES    1000000L        // reads of an entry before giving up on it
+#define LATEST_FIELDS   5               // temp1, temp2, rh, press, light
+
+typedef struct {
+    uint32_t seq;                       // odd while the entry is being written
+    uint32_t pad;
+    char     sensor[50];                // alias, or sensorID
+    char     date_time[20];             // as recorded, 'YYYY-mm-dd HH:MM:SS'
+    int64_t  rxtime;                    // when received, sec from 1970
+    double   value[LATEST_FIELDS];
+} latestEntry;
+
+typedef struct {
+    uint32_t    magic;                  // LATEST_MAGIC
+    uint32_t    version;                // LATEST_VERSION
+    uint32_t    size;                   // sizeof(latestTable)
+    uint32_t    count;                  // entries in use
+    int64_t     updated;                // when an entry was last written
+    latestEntry entry[LATEST_SENSORS];
+} latestTable;
+
+// Copy entry 'i' of table 't' to 'e', trying again while it's being
+//   written, up to LATEST_TRIES times; false if it never settled (the
+//   writer died while writing it, until WDL_433 is restarted)
+static inline bool latestRead(const latestTable *t, int i, latestEntry *e) {
+    const latestEntry *src = &t->entry[i];
+    uint32_t s1, s2;
+    for (long n = 0; n < LATEST_TRIES; n++) {
+        if ( (s1 = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE)) & 1 ) continue;
+        memcpy(e, (const void *)src, sizeof(*e));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&src->seq, __ATOMIC_RELAXED);
+        if (s1 == s2) return true;
+    };
+    return false;
+};
+
+#endif
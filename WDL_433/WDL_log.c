@@ -0,0 +1,271 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_log.c
+    Asynchronous logging for WDL_433, weather data logger for rtl_433
+
+    Log calls reserve a slot in a fixed-size ring of preallocated
+    records, copy their data into it, and return.  A background
+    thread formats the records and writes them out.  The ring is a
+    bounded multi-producer, single-consumer queue: each slot carries
+    a sequence number that tells producers when it is free and the
+    consumer when it has been filled, so no locks are needed.  If
+    the ring is full, the record is dropped and counted rather than
+    making the caller wait.
+
+    Three kinds of record can be logged:
+      - logMsg() formats a printf-style message directly into the slot;
+      - logStr() copies an already-formatted string (such as an SQL
+        command) after a constant label;
+      - logRow() copies a DBRecord, which the background thread formats.
+    The last two cost the caller only a memcpy.
+
+    Until logStart() is called, and after logStop(), records are
+    written synchronously.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "WDL_433.h"
+
+#define LOG_SLOTS 1024            // must be a power of 2
+#define LOG_TEXT  320             // room for an SQL INSERT command
+
+typedef enum {LK_MSG, LK_STR, LK_ROW} logkind_t;
+
+typedef struct {
+    atomic_size_t seq;
+    uint8_t       mod, lvl, kind;
+    const char   *label;
+    union {
+        char      text[LOG_TEXT];
+        DBRecord  row;
+    } u;
+} logslot_t;
+
+static struct {
+    atomic_size_t head;           // next slot for producers
+    size_t        tail;           // next slot for the consumer
+    atomic_bool   waiting;        // consumer is (about to be) asleep
+    atomic_bool   running;
+    atomic_ulong  dropped;
+    int           wakefd;
+    pthread_t     thread;
+    logslot_t     slot[LOG_SLOTS];
+} ring;
+
+uint8_t logLevel[LM_COUNT] = { [0 ... LM_COUNT-1] = LV_INFO };
+static const char *logModName[LM_COUNT] = {"main", "params", "db", "fresh", "state", "ev", "spool", "pub", "http"};
+static const char *logLvlName[] = {"err", "warn", "info", "debug"};
+
+// Format a record into 'buf'; returns the length
+static int logFormat(logslot_t *s, char *buf, int len) {
+    int n = 0;
+    if (s->lvl <= LV_WARN)
+        n = snprintf(buf, len, "%s %s: ", (s->lvl == LV_ERR) ? "?" : "%",
+                     logModName[s->mod]);
+    switch (s->kind) {
+    case LK_MSG:
+        n += snprintf(buf+n, len-n, "%s", s->u.text);
+        break;
+    case LK_STR:
+        n += snprintf(buf+n, len-n, "%s%s\n", s->label, s->u.text);
+        break;
+    case LK_ROW:
+        n += snprintf(buf+n, len-n,
+                      "%s: %20s, %5.1f\u00B0C\t%5.1f\u00B0C\t%4.0f%% RH\t%6.1f h_Pa\t%4.0f%% light\n",
+                      s->u.row.date_time, s->u.row.sensorID,
+                      s->u.row.temp1, s->u.row.temp2,
+                      s->u.row.rh, s->u.row.press, s->u.row.light);
+        break;
+    };
+    return (n < len) ? n : len-1;
+};
+
+static void logWrite(logslot_t *s) {
+    char buf[LOG_TEXT+128];
+    int  n = logFormat(s, buf, sizeof(buf));
+    fwrite(buf, 1, n, (s->lvl <= LV_WARN) ? stderr : stdout);
+};
+
+// Reserve a slot; returns NULL if the ring is full
+static logslot_t *logReserve(size_t *pos) {
+    logslot_t *s;
+    size_t p = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    for (;;) {
+        s = &ring.slot[p & (LOG_SLOTS-1)];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)p;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring.head, &p, p+1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            atomic_fetch_add(&ring.dropped, 1);
+            return NULL;
+        } else
+            p = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    };
+    *pos = p;
+    return s;
+};
+
+// Hand a filled slot to the consumer and wake it if it's asleep
+static void logCommit(logslot_t *s, size_t pos) {
+    uint64_t one = 1;
+    atomic_store_explicit(&s->seq, pos+1, memory_order_release);
+    if (atomic_exchange(&ring.waiting, false))
+        if (write(ring.wakefd, &one, sizeof(one)) < 0) {};
+};
+
+// Background thread: drain the ring, then sleep until woken
+static void *logThread(void *arg) {
+    uint64_t n;
+    for (;;) {
+        logslot_t *s = &ring.slot[ring.tail & (LOG_SLOTS-1)];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq == ring.tail+1) {
+            logWrite(s);
+            atomic_store_explicit(&s->seq, ring.tail+LOG_SLOTS, memory_order_release);
+            ring.tail++;
+            continue;
+        };
+        // Ring is empty: flush output, then sleep unless something arrived
+        fflush(stdout);
+        if (!atomic_load(&ring.running)) break;
+        atomic_store(&ring.waiting, true);
+        seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq == ring.tail+1) {
+            atomic_store(&ring.waiting, false);
+            continue;
+        };
+        if (read(ring.wakefd, &n, sizeof(n)) < 0) {};
+    };
+    return NULL;
+};
+
+void logStart(void) {
+    for (size_t i = 0; i < LOG_SLOTS; i++)
+        atomic_init(&ring.slot[i].seq, i);
+    atomic_init(&ring.head, 0);
+    ring.tail = 0;
+    ring.wakefd = eventfd(0, EFD_CLOEXEC);
+    if (ring.wakefd < 0) {
+        perror("?WDL_433: can't create logging eventfd");
+        return;
+    };
+    atomic_store(&ring.running, true);
+    if (pthread_create(&ring.thread, NULL, logThread, NULL) != 0) {
+        fprintf(stderr, "?WDL_433: can't start logging thread; logging synchronously\n");
+        atomic_store(&ring.running, false);
+        close(ring.wakefd);
+        return;
+    };
+    atexit(logStop);
+};
+
+// Drain the ring and stop the background thread
+void logStop(void) {
+    uint64_t one = 1;
+    if (!atomic_exchange(&ring.running, false)) return;
+    if (write(ring.wakefd, &one, sizeof(one)) < 0) {};
+    pthread_join(ring.thread, NULL);
+    close(ring.wakefd);
+    if (ring.dropped > 0)
+        fprintf(stderr, "%%WDL_433: %lu log records dropped: log ring was full\n",
+                (unsigned long)ring.dropped);
+    fflush(stdout);
+};
+
+// Reserve a slot, or use a local one if logging synchronously
+#define LOG_BEGIN(s, pos, local)                                    \
+    if (!atomic_load(&ring.running)) s = &local;                    \
+    else if ((s = logReserve(&pos)) == NULL) return;
+
+#define LOG_END(s, pos, local)                                      \
+    if (s == &local) logWrite(s);                                   \
+    else logCommit(s, pos);
+
+void logMsg(logmod_t mod, loglevel_t lvl, const char *fmt, ...) {
+    logslot_t *s, local;
+    size_t pos = 0;
+    va_list ap;
+    LOG_BEGIN(s, pos, local);
+    s->mod = mod; s->lvl = lvl; s->kind = LK_MSG;
+    va_start(ap, fmt);
+    vsnprintf(s->u.text, LOG_TEXT, fmt, ap);
+    va_end(ap);
+    LOG_END(s, pos, local);
+};
+
+void logStr(logmod_t mod, loglevel_t lvl, const char *label, const char *text) {
+    logslot_t *s, local;
+    size_t pos = 0, len = strlen(text);
+    if (len >= LOG_TEXT) len = LOG_TEXT-1;
+    LOG_BEGIN(s, pos, local);
+    s->mod = mod; s->lvl = lvl; s->kind = LK_STR;
+    s->label = label;
+    memcpy(s->u.text, text, len);
+    s->u.text[len] = '\0';
+    LOG_END(s, pos, local);
+};
+
+void logRow(logmod_t mod, loglevel_t lvl, const DBRecord *row) {
+    logslot_t *s, local;
+    size_t pos = 0;
+    LOG_BEGIN(s, pos, local);
+    s->mod = mod; s->lvl = lvl; s->kind = LK_ROW;
+    memcpy(&s->u.row, row, sizeof(DBRecord));
+    LOG_END(s, pos, local);
+};
+
+static int logLevelIndex(char *name) {
+    for (int i = LV_ERR; i <= LV_DEBUG; i++)
+        if (strcmp(name, logLvlName[i]) == 0) return i;
+    fprintf(stderr, "Invalid log level '%s': use err, warn, info, or debug\n", name);
+    exit(1);
+};
+
+// Set log levels from a list such as "debug" (all modules)
+//   or "db=debug,fresh=warn"
+void setLog(char *optarg) {
+    char *spec, *item, *save, *eq;
+    if ( (spec = strdup(optarg)) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strLower(spec);
+    for (item = strtok_r(spec, ",", &save); item != NULL;
+         item = strtok_r(NULL, ",", &save)) {
+        if ( (eq = strchr(item, '=')) == NULL ) {
+            int lvl = logLevelIndex(item);
+            for (int m = 0; m < LM_COUNT; m++) logLevel[m] = lvl;
+            continue;
+        };
+        *eq = '\0';
+        int m;
+        for (m = 0; m < LM_COUNT; m++)
+            if (strcmp(item, logModName[m]) == 0) break;
+        if (m == LM_COUNT) {
+            fprintf(stderr, "Invalid module '%s' for '--log' option\n", item);
+            exit(1);
+        };
+        logLevel[m] = logLevelIndex(eq+1);
+    };
+    free(spec);
+};
+
+void logPrintLevels(void) {
+    printf("log      =");
+    for (int m = 0; m < LM_COUNT; m++)
+        printf("%s%s=%s", (m == 0) ? " " : ",", logModName[m], logLvlName[logLevel[m]]);
+    printf("\n");
+};
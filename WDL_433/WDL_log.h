@@ -0,0 +1,45 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*
+    WDL_log.h
+    Definitions for the asynchronous logging procedures of WDL_433
+
+    Log records are placed in a preallocated, lock-free ring buffer
+    and a background thread formats them and writes them to stdout
+    (or stderr for warnings and errors), so a log call in the
+    message-processing path never blocks on output.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Log levels, in order of increasing verbosity
+typedef enum {LV_ERR=0, LV_WARN, LV_INFO, LV_DEBUG} loglevel_t;
+
+// Program modules that can have their log levels set individually
+// Keep 'logModName[]' in WDL_log.c aligned with this list
+typedef enum {LM_MAIN=0, LM_PARAMS, LM_DB, LM_FRESH, LM_STATE, LM_EV, LM_SPOOL, LM_PUB, LM_HTTP, LM_COUNT} logmod_t;
+
+// Current log level for each module
+extern uint8_t logLevel[LM_COUNT];
+
+// Log a printf-style message if 'lvl' is enabled for 'mod'
+#define LOG(mod, lvl, ...)                                          \
+    do {                                                            \
+        if ((lvl) <= logLevel[mod]) logMsg(mod, lvl, __VA_ARGS__);  \
+    } while (0)
+
+// True if messages at level 'lvl' are enabled for 'mod'
+#define LOGGING(mod, lvl) ((lvl) <= logLevel[mod])
+
+void logStart(void);
+void logStop(void);
+void logMsg(logmod_t mod, loglevel_t lvl, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+// 'label' must be a constant string: only its pointer is recorded
+void logStr(logmod_t mod, loglevel_t lvl, const char *label, const char *text);
+void logRow(logmod_t mod, loglevel_t lvl, const DBRecord *row);
+void setLog(char *optarg);
+void logPrintLevels(void);
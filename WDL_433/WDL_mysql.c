@@ -0,0 +1,427 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_mysql.c
+    MariaDB/MySQL storage backend for WDL_433, weather data logger for rtl_433
+
+    Built only when WDL_433 is made with USE_MYSQL=1, since it needs
+    the MariaDB client library.  Selected with 'backend = mysql'.
+
+    Written by HDTodd, hdtodd@gmail.com, 2016, for use with WeatherStation.c
+    Revised 2025.04.15 for use with WDL_433, weather data logger for rtl_433
+*/
+
+#ifdef USE_MYSQL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <poll.h>
+#include <mariadb/mysql.h>
+#include <mariadb/errmsg.h>
+
+#include "WDL_433.h"
+
+#define sqlStringLen 512
+
+extern char *myHost;                          // server host (default=localhost)
+extern char *myUser;                          // username (default=login name)
+extern char *myPass;                          // password (default=none)
+extern aggregate_t aggregate;
+static unsigned int opt_port_num = 3306;      // port number (use built-in value)
+static char *opt_socket_name     = NULL;      // socket name (use built-in value)
+static unsigned int opt_flags    = 0;         // connection flags (none)
+static MYSQL *mysql = NULL;                   // connection handler
+
+/*  The MySQL connection is non-blocking (MYSQL_OPT_NONBLOCK) and is
+    driven from the event loop of its sink's writer thread.  Each operation is started with
+    a mysql_*_start() call and continued with mysql_*_cont() whenever
+    the socket is ready (or the operation's timeout expires), so
+    ingest continues while an INSERT is on its way to the server.
+    A lost connection is re-established, with delays increasing from
+    MY_RECONNECT_MIN to MY_RECONNECT_MAX, by the same sequence of
+    operations: connect, then the statements in mySetup[].
+*/
+#define MY_RECONNECT_MIN 1000         // first reconnect delay, msec
+#define MY_RECONNECT_MAX 60000        // longest reconnect delay, msec
+
+typedef enum {MY_DOWN, MY_CONNECT, MY_SETUP, MY_IDLE, MY_INSERT} mystate_t;
+
+// Create the database and table if necessary and make them current
+//   and, with 'aggregate = minmax', add the columns for the windows'
+//   minima and maxima (an error if they're there already: MY_DUP_COLUMN)
+static const char *mySetup[] = {
+    "CREATE DATABASE IF NOT EXISTS " DBNAME,
+    "USE " DBNAME,
+    "CREATE TABLE IF NOT EXISTS " DBTABLE " (date_time char(20), sensorID char(50), "
+        "temp1 float, temp2 float, rh float, press float, light float)",
+    "ALTER TABLE " DBTABLE " ADD COLUMN (temp1_min float, temp1_max float, "
+        "temp2_min float, temp2_max float, rh_min float, rh_max float, "
+        "press_min float, press_max float, light_min float, light_max float)",
+};
+#define MY_NSETUP ((aggregate == AGG_MINMAX) ? 4 : 3)
+#define MY_DUP_COLUMN 1060            // ER_DUP_FIELDNAME
+
+// Is the error of the last operation a lost connection, rather than
+//   one with the statement (which reconnecting wouldn't cure)?
+static bool myConnError(MYSQL *m) {
+    switch (mysql_errno(m)) {
+    case CR_CONNECTION_ERROR:
+    case CR_CONN_HOST_ERROR:
+    case CR_SERVER_GONE_ERROR:
+    case CR_SERVER_LOST:
+    case CR_UNKNOWN_HOST:
+        return true;
+    default:
+        return false;
+    };
+};
+
+static mystate_t myState   = MY_DOWN;
+static int       mySocket  = -1;      // socket being watched, or -1
+static int       myTimer   = 0;       // timeout of the current operation
+static int       myRetry   = 0;       // reconnect timer
+static int       myStatus  = 0;       // MYSQL_WAIT_* the operation is waiting for
+static int       myStep    = 0;       // index in mySetup[]
+static long      myDelay   = MY_RECONNECT_MIN;
+static dbdone_cb myDone    = NULL;
+static void     *myArg     = NULL;
+static sink_t   *mySink    = NULL;    // the sink using this backend
+static evloop_t *myLoop    = NULL;    // and its event loop
+static char     *myInsert  = NULL;    // multi-row INSERT command
+static size_t    myInsertLen = 0;
+
+static void myContinue(int status);
+
+static MYSQL *myNew(void) {
+    MYSQL *m;
+    if ( (m = mysql_init(0)) == NULL ) {
+        fprintf(stderr, "?mysql_init() failed (probably out of memory)\n");
+        exit(EXIT_FAILURE);
+    };
+    mysql_options(m, MYSQL_OPT_NONBLOCK, 0);
+    return m;
+};
+
+// The socket is ready, or there's an error on it
+static void myEvent(int fd, uint32_t events, void *arg) {
+    int status = 0;
+    if (myState == MY_IDLE) {
+        // The server doesn't talk unless asked: it has closed the connection
+        LOG(LM_DB, LV_WARN, "MySQL server '%s' closed the connection\n", myHost);
+        myContinue(-1);
+        return;
+    };
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) status |= MYSQL_WAIT_READ;
+    if (events & EPOLLOUT)                        status |= MYSQL_WAIT_WRITE;
+    if (events & EPOLLPRI)                        status |= MYSQL_WAIT_EXCEPT;
+    myContinue(status);
+};
+
+static void myTimeout(void *arg) {
+    myTimer = 0;
+    myContinue(MYSQL_WAIT_TIMEOUT);
+};
+
+// Watch the socket for what the operation is waiting for ('status'),
+//   or just for the connection closing when idle ('status' = 0)
+static void myWait(int status) {
+    uint32_t events = 0;
+    myStatus = status;
+    if (status & MYSQL_WAIT_READ)   events |= EPOLLIN;
+    if (status & MYSQL_WAIT_WRITE)  events |= EPOLLOUT;
+    if (status & MYSQL_WAIT_EXCEPT) events |= EPOLLPRI;
+    if (status == 0)                events  = EPOLLIN;
+    if (mySocket < 0) {
+        mySocket = mysql_get_socket(mysql);
+        evAddFd(myLoop, mySocket, events, myEvent, NULL);
+    } else
+        evModFd(myLoop, mySocket, events);
+    if (myTimer != 0) evCancel(myLoop, myTimer);
+    myTimer = (status & MYSQL_WAIT_TIMEOUT)
+        ? evTimer(myLoop, mysql_get_timeout_value_ms(mysql), false, myTimeout, NULL) : 0;
+};
+
+static void myReconnect(void *arg);
+
+// The connection failed or was lost: fail any INSERT in progress and try again later
+static void myLost(void) {
+    dbdone_cb done = myDone;
+    if (mysql != NULL) {
+        if (myState != MY_IDLE)
+            LOG(LM_DB, LV_ERR, "MySQL error: %s\n", mysql_error(mysql));
+        if (mySocket >= 0) evDelFd(myLoop, mySocket);
+        mysql_close(mysql);
+        mysql = NULL;
+    };
+    if (myTimer != 0) evCancel(myLoop, myTimer);
+    mySocket = -1;
+    myTimer  = 0;
+    myState  = MY_DOWN;
+    myDone   = NULL;
+    if (myRetry == 0) {
+        LOG(LM_DB, LV_DEBUG, "Reconnecting to MySQL server in %ld msec\n", myDelay);
+        myRetry = evTimer(myLoop, myDelay, false, myReconnect, NULL);
+        myDelay = (2*myDelay > MY_RECONNECT_MAX) ? MY_RECONNECT_MAX : 2*myDelay;
+    };
+    if (done != NULL) done(myArg, DB_DOWN);
+};
+
+// Start a query; myContinue() picks up when it completes
+static void myQuery(const char *sql, unsigned long len) {
+    int err, status;
+    status = mysql_real_query_start(&err, mysql, sql, len);
+    if (status != 0)
+        myWait(status);
+    else
+        myContinue(err ? -1 : 0);
+};
+
+// The connection is usable: reset the reconnect delay and tell the storage stage
+static void myReady(void) {
+    myState = MY_IDLE;
+    myDelay = MY_RECONNECT_MIN;
+    myWait(0);
+};
+
+// Continue the current operation now that the socket is ready ('status'),
+//   or handle its completion ('status' = 0), or its failure ('status' < 0)
+static void myContinue(int status) {
+    MYSQL *ret;
+    int    err = 0;
+
+    if (status < 0) {
+        myLost();
+        return;
+    };
+    switch (myState) {
+    case MY_CONNECT:
+        if (status != 0) {
+            status = mysql_real_connect_cont(&ret, mysql, status);
+            if (status != 0) { myWait(status); return; };
+            if (ret == NULL) { myLost(); return; };
+        };
+        LOG(LM_DB, LV_DEBUG, "Connected to MySQL server '%s'\n", myHost);
+        myState = MY_SETUP;
+        myStep  = 0;
+        myQuery(mySetup[0], strlen(mySetup[0]));
+        return;
+    case MY_SETUP:
+    case MY_INSERT:
+        if (status != 0) {
+            status = mysql_real_query_cont(&err, mysql, status);
+            if (status != 0) { myWait(status); return; };
+            if ( (err != 0) && (myState == MY_INSERT) && !myConnError(mysql) ) {
+                // The server is there but won't take the batch: give it back
+                LOG(LM_DB, LV_ERR, "MySQL error: %s\n", mysql_error(mysql));
+                dbdone_cb done = myDone;
+                myDone = NULL;
+                myReady();
+                done(myArg, DB_REJECTED);
+                return;
+            };
+            if ( (err != 0)
+                 && !((myState == MY_SETUP) && (mysql_errno(mysql) == MY_DUP_COLUMN)) ) {
+                myLost();
+                return;
+            };
+        };
+        break;
+    default:
+        return;
+    };
+
+    // A query has completed
+    if (myState == MY_SETUP) {
+        if (++myStep < MY_NSETUP) {
+            myQuery(mySetup[myStep], strlen(mySetup[myStep]));
+            return;
+        };
+        LOG(LM_DB, LV_INFO, "Reconnected to MySQL server '%s'\n", myHost);
+        myReady();
+        storeWake(mySink);
+        return;
+    };
+    dbdone_cb done = myDone;
+    myDone = NULL;
+    myReady();
+    done(myArg, DB_OK);
+};
+
+// Reconnect timer: start connecting without waiting for the server
+static void myReconnect(void *arg) {
+    MYSQL *ret;
+    int    status;
+    myRetry = 0;
+    mysql   = myNew();
+    myState = MY_CONNECT;
+    status  = mysql_real_connect_start(&ret, mysql, myHost, myUser, myPass,
+                                       NULL, opt_port_num, opt_socket_name, opt_flags);
+    if (status != 0)
+        myWait(status);
+    else if (ret == NULL)
+        myLost();
+    else
+        myContinue(0);
+};
+
+// Connect to the MySQL server at startup and create the database and table
+//   if necessary, waiting for the result
+// On failure, say why and leave 'mysql' NULL
+static bool myConnect(void) {
+    LOG(LM_DB, LV_DEBUG, "Check for and connect to MySQL database on host '%s'\n", myHost);
+    mysql = myNew();
+    if (mysql_real_connect(mysql, // connect to server
+                myHost, myUser, myPass,
+                NULL, opt_port_num, opt_socket_name,
+                opt_flags) == NULL) {
+        LOG(LM_DB, LV_ERR, "mysql_real_connect() failed to connect to database: %s\n",
+            mysql_error(mysql));
+        goto fail;
+    };
+    LOG(LM_DB, LV_DEBUG, "Connected to server '%s'\n", myHost);
+
+    // Create the database and table if they don't exist, and use them
+    for (int i = 0; i < MY_NSETUP; i++) {
+        LOG(LM_DB, LV_DEBUG, "MySQL setup command\n   %s\n", mySetup[i]);
+        if ( (mysql_query(mysql, mySetup[i]) != 0) && (mysql_errno(mysql) != MY_DUP_COLUMN) ) {
+            LOG(LM_DB, LV_ERR, "MySQL couldn't create or select database '%s' or table '%s': %s\n",
+                DBNAME, DBTABLE, mysql_error(mysql));
+            goto fail;
+        };
+    };
+
+    // Database and table exist and 'mysql' points to it; leave connection open
+    myReady();
+    return true;
+
+fail:
+    mysql_close(mysql);
+    mysql = NULL;
+    return false;
+};
+
+// Wait for an INSERT in progress to complete (used when stopping)
+static void myFlush(void) {
+    struct pollfd pfd;
+    while (myState == MY_INSERT) {
+        int status = 0, timeout = -1;
+        pfd.fd      = mySocket;
+        pfd.events  = 0;
+        pfd.revents = 0;
+        if (myStatus & MYSQL_WAIT_READ)    pfd.events |= POLLIN;
+        if (myStatus & MYSQL_WAIT_WRITE)   pfd.events |= POLLOUT;
+        if (myStatus & MYSQL_WAIT_EXCEPT)  pfd.events |= POLLPRI;
+        if (myStatus & MYSQL_WAIT_TIMEOUT) timeout = mysql_get_timeout_value_ms(mysql);
+        int n = poll(&pfd, 1, timeout);
+        if (n < 0) continue;
+        if (n == 0)                               status  = MYSQL_WAIT_TIMEOUT;
+        if (pfd.revents & (POLLIN|POLLHUP|POLLERR)) status |= MYSQL_WAIT_READ;
+        if (pfd.revents & POLLOUT)                status |= MYSQL_WAIT_WRITE;
+        if (pfd.revents & POLLPRI)                status |= MYSQL_WAIT_EXCEPT;
+        myContinue(status);
+    };
+};
+
+// If the server can't be reached now, records are spooled until it can
+static bool myInit(sink_t *sk) {
+    mySink = sk;
+    myLoop = sinkLoop(sk);
+    if (myConnect()) return true;
+    LOG(LM_DB, LV_WARN, "MySQL server '%s' unavailable: spooling records\n", myHost);
+    myLost();
+    return false;
+};
+
+// The connection is re-established by the backend itself: ready if it's up
+static bool myPrepare(void) {
+    return (myState == MY_IDLE);
+};
+
+// Send 'n' records as one multi-row INSERT; 'done' is called when the server replies
+static void myAppend(DBRecord *rows, int n, dbdone_cb done, void *arg) {
+    size_t len;
+
+    // Only one INSERT at a time; the storage stage collects the next batch meanwhile
+    if (myState != MY_IDLE) {
+        done(arg, DB_DOWN);
+        return;
+    };
+
+    // One multi-row INSERT for the batch
+    if (myInsertLen < (size_t)(n+1)*sqlStringLen) {
+        myInsertLen = (n+1)*sqlStringLen;
+        if ( (myInsert = realloc(myInsert, myInsertLen)) == NULL ) {
+            fprintf(stderr, "?Out of memory for MySQL INSERT command\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    len = snprintf(myInsert, myInsertLen,
+                   "INSERT INTO %s (date_time, sensorID, temp1, temp2, rh, press, light%s) VALUES ",
+                   DBTABLE, (aggregate == AGG_MINMAX)
+                   ? ", temp1_min, temp1_max, temp2_min, temp2_max, rh_min, rh_max,"
+                     " press_min, press_max, light_min, light_max" : "");
+    for (int i = 0; i < n; i++) {
+        DBRecord *DBRow = &rows[i];
+        char date_time[2*sizeof(DBRow->date_time)+1], sensorID[2*sizeof(DBRow->sensorID)+1];
+        mysql_real_escape_string(mysql, date_time, DBRow->date_time,
+                                 strnlen(DBRow->date_time, sizeof(DBRow->date_time)));
+        mysql_real_escape_string(mysql, sensorID, DBRow->sensorID,
+                                 strnlen(DBRow->sensorID, sizeof(DBRow->sensorID)));
+        len += snprintf(myInsert+len, myInsertLen-len,
+                        "%s('%s', '%s', %5.1f, %5.1f, %3.0f, %6.1f, %3.0f",
+                        (i == 0) ? "" : ",",
+                        date_time, sensorID, DBRow->temp1, DBRow->temp2,
+                        DBRow->rh, DBRow->press, DBRow->light);
+        if (aggregate == AGG_MINMAX)
+            for (int f = 0; f < AGG_FIELDS; f++)
+                len += snprintf(myInsert+len, myInsertLen-len, ", %.*f, %.*f",
+                                aggDigits[f], DBRow->min[f], aggDigits[f], DBRow->max[f]);
+        len += snprintf(myInsert+len, myInsertLen-len, ")");
+    };
+    if (LOGGING(LM_DB, LV_DEBUG))
+        logStr(LM_DB, LV_DEBUG, "MySQL insert command:\n    ", myInsert);
+    myDone  = done;
+    myArg   = arg;
+    myState = MY_INSERT;
+    myQuery(myInsert, len);
+};
+
+static void myClose(void) {
+    if (myRetry != 0) evCancel(myLoop, myRetry);
+    if (myTimer != 0) evCancel(myLoop, myTimer);
+    if (mySocket >= 0) evDelFd(myLoop, mySocket);
+    if (mysql != NULL) mysql_close(mysql);
+    mysql    = NULL;
+    mySocket = -1;
+    myRetry  = myTimer = 0;
+    myState  = MY_DOWN;
+};
+
+static void myLastTimes(void (*cb)(char *sensorID, char *date_time)) {
+    char sql[sqlStringLen];
+    MYSQL_RES *res;
+    MYSQL_ROW  row;
+    if (myState != MY_IDLE) return;
+    snprintf(sql, sizeof(sql),
+             "SELECT sensorID, MAX(date_time) FROM %s GROUP BY sensorID", DBTABLE);
+    if (mysql_query(mysql, sql) != 0) {
+        LOG(LM_DB, LV_WARN, "MySQL error reading latest rows: %s\n", mysql_error(mysql));
+        return;
+    };
+    if ( (res = mysql_store_result(mysql)) == NULL ) return;
+    while ( (row = mysql_fetch_row(res)) != NULL )
+        if ( (row[0] != NULL) && (row[1] != NULL) ) cb(row[0], row[1]);
+    mysql_free_result(res);
+};
+
+backend_t mysqlBackend = {
+    .name        = "mysql",
+    .init        = myInit,
+    .prepare     = myPrepare,
+    .appendBatch = myAppend,
+    .flush       = myFlush,
+    .close       = myClose,
+    .lastTimes   = myLastTimes,
+};
+
+#endif // USE_MYSQL
@@ -0,0 +1,119 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_now.c
+    Print current conditions from the "latest readings" table that
+    WDL_433, weather data logger for rtl_433, keeps in shared memory
+    (the 'latest' setting), without opening the database:
+        WDL_now [-n /WDL_433] [-j] [sensor ...]
+    prints the latest reading of each sensor named (sensorID or alias,
+    as recorded), or of every sensor, as text or, with -j, as JSON:
+        {"Deck":{"date_time":"2025-07-01 12:05:00","temp1":21.4,...},...}
+    Exits 1 if a sensor named isn't in the table, or an entry can't be read.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+#include "WDL_latest.h"
+
+#define LATEST_NAME "/WDL_433"
+
+static const char *fields[LATEST_FIELDS] = { "temp1", "temp2", "rh", "press", "light" };
+static const int   digits[LATEST_FIELDS] = { 1, 1, 0, 1, 0 };
+
+// Print 's' as a JSON string: quoted, with '"', '\' and control characters escaped
+static void printString(const char *s) {
+    putchar('"');
+    for (; *s != '\0'; s++)
+        if ( (*s == '"') || (*s == '\\') ) printf("\\%c", *s);
+        else if ((unsigned char)*s < ' ')  printf("\\u%04x", *s);
+        else                               putchar(*s);
+    putchar('"');
+};
+
+static void print(latestEntry *e, bool json, bool first) {
+    if (json) {
+        if (!first) putchar(',');
+        printString(e->sensor);
+        printf(":{\"date_time\":");
+        printString(e->date_time);
+        for (int f = 0; f < LATEST_FIELDS; f++)
+            printf(",\"%s\":%.*f", fields[f], digits[f], e->value[f]);
+        printf("}");
+    } else {
+        printf("%-24s %s", e->sensor, e->date_time);
+        for (int f = 0; f < LATEST_FIELDS; f++)
+            printf("  %s %.*f", fields[f], digits[f], e->value[f]);
+        printf("\n");
+    };
+};
+
+int main(int argc, char *argv[]) {
+    const latestTable *t;
+    latestEntry        e;
+    char              *name = LATEST_NAME;
+    bool               json = false, first = true;
+    int                c, fd, rc = EXIT_SUCCESS;
+    uint32_t           n;
+
+    while ( (c = getopt(argc, argv, "n:jh")) != -1 )
+        switch (c) {
+        case 'n': name = optarg; break;
+        case 'j': json = true;   break;
+        default:
+            fprintf(stderr, "Usage: %s [-n shared-memory name (%s)] [-j (JSON)] [sensor ...]\n",
+                    argv[0], LATEST_NAME);
+            exit(EXIT_FAILURE);
+        };
+    if ( (fd = shm_open(name, O_RDONLY, 0)) < 0 ) {
+        fprintf(stderr, "?WDL_now: can't open shared memory '%s': %s\n", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    t = mmap(NULL, sizeof(latestTable), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( (t == MAP_FAILED) || (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != LATEST_MAGIC)
+         || (t->version != LATEST_VERSION) || (t->size != sizeof(latestTable)) ) {
+        fprintf(stderr, "?WDL_now: '%s' isn't a WDL_433 latest-readings table\n", name);
+        exit(EXIT_FAILURE);
+    };
+
+    n = __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+    if (n > LATEST_SENSORS) n = LATEST_SENSORS;
+    if (json) printf("{");
+    if (optind == argc)
+        for (uint32_t i = 0; i < n; i++) {
+            if (!latestRead(t, i, &e)) {
+                fprintf(stderr, "?WDL_now: entry %u of '%s' can't be read: "
+                        "restart WDL_433\n", i, name);
+                rc = EXIT_FAILURE;
+                continue;
+            };
+            print(&e, json, first);
+            first = false;
+        };
+    for (int a = optind; a < argc; a++) {
+        uint32_t i;
+        // Compare the copies: an entry may be taken over by another sensor
+        for (i = 0; i < n; i++)
+            if ( latestRead(t, i, &e) && (strncmp(e.sensor, argv[a], sizeof(e.sensor)) == 0) )
+                break;
+        if (i == n) {
+            fprintf(stderr, "?WDL_now: no reading for '%s'\n", argv[a]);
+            rc = EXIT_FAILURE;
+            continue;
+        };
+        print(&e, json, first);
+        first = false;
+    };
+    if (json) printf("}\n");
+    return rc;
+};
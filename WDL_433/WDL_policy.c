@@ -0,0 +1,349 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_policy.c
+    Per-sensor recording policy for WDL_433, weather data logger for
+    rtl_433
+
+    Without a policy, a sensor is recorded once every 'recordingInterval'
+    seconds, however much or little its readings change.  The [policy]
+    section of WDL_433.ini sets, for any sensor (by sensorID or alias)
+    and for 'default':
+        min=<time>      never record the sensor more often than this
+        max=<time>      always record it at least this often
+        temp=<degC>     deadbands: record it (if 'min' has passed)
+        rh=<%>            when temp1 or temp2, rh, press or light
+        press=<hPa>       has moved by at least this much since it
+        light=<lux>       was last recorded
+    e.g.
+        [policy]
+        default          = min=5m, max=5m
+        Freezer          = max=1h, temp=0.5
+        Deck             = min=30s, max=10m, temp=0.3, rh=3
+    Times are in seconds unless followed by s, m or h.  A setting a
+    sensor's policy doesn't give is taken from the default policy, and
+    one the default doesn't give from the built-in policy: min and max
+    'recordingInterval', no deadbands, which records exactly as before.
+    A sensor's values when last recorded aren't saved across restarts,
+    so its first reading after 'min' has passed is recorded.
+
+    With 'aggregate = mean', the readings received between recordings
+    (the window) are accumulated, and the row recorded at the end of
+    the window, with the time of its last reading, holds their means;
+    'aggregate = minmax' also records their minima and maxima, in
+    columns temp1_min, temp1_max, etc.  The deadbands then measure a
+    change from the last reading in the window last recorded, rather
+    than from its mean.  A reading that has moved beyond a deadband
+    ends the window early: the row recorded holds the
+    window's readings up to and including it.  A window is otherwise
+    ended by the first reading after 'max', so if a sensor goes quiet,
+    a timer records its window once it has been open POL_FLUSH sec past
+    'max'; and when WDL_433 stops (or finishes an import), every window
+    still open is recorded, rather than lost.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+
+#include "WDL_433.h"
+
+#define POL_FLUSH 60                // sec between checks for quiet sensors' windows
+
+extern aggregate_t aggregate;
+extern NPTR        sensors;
+
+// Fields that are aggregated, in the order of DBRecord's 'min' and 'max',
+//   and the decimal places they're recorded with
+const char *aggFields[AGG_FIELDS] = { "temp1", "temp2", "rh", "press", "light" };
+const int   aggDigits[AGG_FIELDS] = { 1, 1, 0, 1, 0 };
+
+static policy_t  builtin = { NULL, recordingInterval, recordingInterval, {0, 0, 0, 0} };
+static policy_t *policies = NULL;   // policies from the .ini file
+static policy_t *dflt = &builtin;   // the 'default' policy
+// The policies being read from the .ini file, put in force by policyInit(),
+//   and the entry being parsed, freed by policyAbort() if it's invalid
+static policy_t *newPolicies = NULL, *newDflt = &builtin;
+static policy_t *parsing = NULL;
+static char     *parsingText = NULL;
+
+static const char *bandNames[POL_BANDS] = { "temp", "rh", "press", "light" };
+
+// Parse a time such as '90', '30s', '5m' or '1h'; -1 if it isn't one
+static int policyTime(char *s) {
+    char  *end;
+    double v = strtod(s, &end);
+    if ( (end == s) || (v < 0) ) return -1;
+    switch (*end) {
+    case '\0': case 's': case 'S':                 break;
+    case 'm':  case 'M':            v *= 60;       break;
+    case 'h':  case 'H':            v *= 3600;     break;
+    default:                        return -1;
+    };
+    if ( (*end != '\0') && (end[1] != '\0') ) return -1;
+    return (int) v;
+};
+
+static void policyError(char *name, char *item) {
+    fprintf(stderr, "?WDL_433: invalid [policy] setting '%s' for '%s'\n"
+            "\tuse e.g. 'min=30s, max=10m, temp=0.5, rh=3, press=1, light=10'\n", item, name);
+    iniInvalid();
+};
+
+// Record the policy in the [policy] entry 'name = settings'
+void setPolicy(char *name, char *settings) {
+    policy_t *p;
+    char     *list, *item, *save, *val, *end;
+    int       b;
+
+    if ( ((p = parsing = calloc(1, sizeof(policy_t))) == NULL)
+         || ((list = parsingText = strdup(settings)) == NULL) ) {
+        fprintf(stderr, "?WDL_433: out of memory for recording policies\n");
+        exit(EXIT_FAILURE);
+    };
+    p->min = p->max = -1;
+    for (b = 0; b < POL_BANDS; b++) p->band[b] = -1;
+    for (item = strtok_r(list, ", \t", &save); item != NULL; item = strtok_r(NULL, ", \t", &save)) {
+        if ( (val = strchr(item, '=')) == NULL ) policyError(name, item);
+        *val++ = '\0';
+        strLower(item);
+        if (strcmp(item, "min") == 0) {
+            if ( (p->min = policyTime(val)) < 0 ) policyError(name, val);
+            continue;
+        };
+        if (strcmp(item, "max") == 0) {
+            if ( (p->max = policyTime(val)) <= 0 ) policyError(name, val);
+            continue;
+        };
+        for (b = 0; b < POL_BANDS; b++)
+            if (strcmp(item, bandNames[b]) == 0) break;
+        if (b == POL_BANDS) policyError(name, item);
+        p->band[b] = strtod(val, &end);
+        if ( (end == val) || (*end != '\0') || (p->band[b] < 0) ) policyError(name, val);
+    };
+    free(list);
+    parsing     = NULL;
+    parsingText = NULL;
+
+    if (strcmp(name, "default") == 0) {
+        // Fill in the default from the built-in policy
+        if (p->min < 0) p->min = builtin.min;
+        if (p->max < 0) p->max = builtin.max;
+        for (b = 0; b < POL_BANDS; b++)
+            if (p->band[b] < 0) p->band[b] = builtin.band[b];
+        if (p->min > p->max) p->min = p->max;
+        if (newDflt != &builtin) free(newDflt);
+        newDflt = p;
+    } else {
+        p->name = strdup(name);
+        p->next = newPolicies;
+        newPolicies = p;
+    };
+};
+
+static void policyFree(policy_t *list, policy_t *def) {
+    policy_t *p, *next;
+    for (p = list; p != NULL; p = next) {
+        next = p->next;
+        free(p->name);
+        free(p);
+    };
+    if (def != &builtin) free(def);
+};
+
+// Forget the policy each sensor in the tree at 'p' was given
+static void policyForget(NPTR p) {
+    if (p == NULL) return;
+    policyForget(p->lptr);
+    if (p->policy != dflt) free(p->policy);
+    p->policy = NULL;
+    policyForget(p->rptr);
+};
+
+// Put the policies read from the .ini file in force, in place of those in
+//   force (if it's being reloaded).  Each sensor's policy is found again
+//   when it's next recorded; the readings and times it was last recorded
+//   with, and its window if aggregating, are kept
+void policyInit(void) {
+    policyForget(sensors);
+    policyFree(policies, dflt);
+    policies    = newPolicies;
+    dflt        = newDflt;
+    newPolicies = NULL;
+    newDflt     = &builtin;
+};
+
+// Drop the policies read so far, if the .ini file they're in can't be used
+void policyAbort(void) {
+    policyFree(newPolicies, newDflt);
+    free(parsing);
+    free(parsingText);
+    newPolicies = NULL;
+    newDflt     = &builtin;
+    parsing     = NULL;
+    parsingText = NULL;
+};
+
+// The policy that applies to 'node': its own, by sensorID or alias,
+//   completed from the default
+static policy_t *policyFind(NPTR node) {
+    policy_t *p, *own = NULL;
+    for (p = policies; p != NULL; p = p->next)
+        if (strcmp(p->name, node->key) == 0) own = p;
+    if (own == NULL && node->alias != NULL)
+        for (p = policies; p != NULL; p = p->next)
+            if (strcmp(p->name, node->alias) == 0) own = p;
+    if (own == NULL) return dflt;
+    if ( (p = malloc(sizeof(policy_t))) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for recording policies\n");
+        exit(EXIT_FAILURE);
+    };
+    *p = *own;
+    p->next = NULL;
+    if (p->min < 0) p->min = dflt->min;
+    if (p->max < 0) p->max = dflt->max;
+    for (int b = 0; b < POL_BANDS; b++)
+        if (p->band[b] < 0) p->band[b] = dflt->band[b];
+    if (p->min > p->max) p->min = p->max;
+    return p;
+};
+
+static bool moved(double now, double then, double band) {
+    return (band > 0) && (fabs(now - then) >= band);
+};
+
+static void rowValues(DBRecord *row, double v[AGG_FIELDS]) {
+    v[0] = row->temp1; v[1] = row->temp2; v[2] = row->rh; v[3] = row->press; v[4] = row->light;
+};
+
+// Add the reading in 'row' to the sensor's window
+static void aggAdd(NPTR node, DBRecord *row) {
+    double v[AGG_FIELDS];
+    rowValues(row, v);
+    if (node->agg.count == 0) node->agg.opened = time(NULL);
+    node->agg.rxtime = row->rxtime;
+    memcpy(node->agg.date_time, row->date_time, sizeof(node->agg.date_time));
+    memcpy(node->agg.last, v, sizeof(node->agg.last));
+    for (int f = 0; f < AGG_FIELDS; f++) {
+        if ( (node->agg.count == 0) || (v[f] < node->agg.min[f]) ) node->agg.min[f] = v[f];
+        if ( (node->agg.count == 0) || (v[f] > node->agg.max[f]) ) node->agg.max[f] = v[f];
+        node->agg.sum[f] = (node->agg.count == 0) ? v[f] : node->agg.sum[f] + v[f];
+    };
+    node->agg.count++;
+};
+
+// Replace the values in 'row' with the window's, and start a new window
+static void aggTake(NPTR node, DBRecord *row) {
+    int n = node->agg.count;
+    row->temp1 = node->agg.sum[0]/n;
+    row->temp2 = node->agg.sum[1]/n;
+    row->rh    = node->agg.sum[2]/n;
+    row->press = node->agg.sum[3]/n;
+    row->light = node->agg.sum[4]/n;
+    memcpy(row->min, node->agg.min, sizeof(row->min));
+    memcpy(row->max, node->agg.max, sizeof(row->max));
+    node->agg.count = 0;
+};
+
+// Has the reading in 'row', from the sensor whose policy is 'p' at
+//   'node', moved beyond a deadband since the sensor was last recorded?
+static bool policyMoved(policy_t *p, NPTR node, DBRecord *row) {
+    return moved(row->temp1, node->last.temp1, p->band[POL_TEMP])
+        || moved(row->temp2, node->last.temp2, p->band[POL_TEMP])
+        || moved(row->rh,    node->last.rh,    p->band[POL_RH])
+        || moved(row->press, node->last.press, p->band[POL_PRESS])
+        || moved(row->light, node->last.light, p->band[POL_LIGHT]);
+};
+
+// Should the reading in 'row', from the sensor at 'node', be recorded?
+//   If readings are aggregated, the reading is added to the window,
+//   and the row to record is given the window's values
+bool policyRecord(NPTR node, DBRecord *row) {
+    policy_t *p;
+    time_t    since;
+    bool      due;
+
+    if (node->policy == NULL) node->policy = policyFind(node);
+    p     = node->policy;
+    since = row->rxtime - node->lasttime;
+    if (since < p->min) due = false;
+    else if ( (since >= p->max) || !node->haveLast ) due = true;
+    else if (policyMoved(p, node, row)) {
+        // A change ends the window, and is recorded with it
+        if (aggregate != AGG_OFF) {
+            aggAdd(node, row);
+            aggTake(node, row);
+        };
+        return true;
+    } else due = false;
+
+    if (aggregate == AGG_OFF) return due;
+    aggAdd(node, row);
+    if (due) aggTake(node, row);
+    return due;
+};
+
+// Note the values of the reading just recorded from 'node' (if
+//   aggregating, of the last reading in the window recorded: the
+//   deadbands measure a change from that, not from the window's mean)
+void policyRecorded(NPTR node, DBRecord *row) {
+    double v[AGG_FIELDS];
+    if (aggregate == AGG_OFF) rowValues(row, v);
+    else                      memcpy(v, node->agg.last, sizeof(v));
+    node->lasttime    = row->rxtime;
+    node->last.temp1  = v[0];
+    node->last.temp2  = v[1];
+    node->last.rh     = v[2];
+    node->last.press  = v[3];
+    node->last.light  = v[4];
+    node->haveLast    = true;
+};
+
+// Record the window of each sensor in the tree at 'p' that has been open
+//   POL_FLUSH sec past its policy's 'max' at 'now', or of every sensor, if 'all'
+static void policyFlush(NPTR p, time_t now, bool all) {
+    DBRecord row;
+    if (p == NULL) return;
+    policyFlush(p->lptr, now, all);
+    if (p->agg.count > 0) {
+        if (p->policy == NULL) p->policy = policyFind(p);
+        if ( all || (now - p->agg.opened >= p->policy->max + POL_FLUSH) ) {
+            memset(&row, 0, sizeof(row));
+            snprintf(row.sensorID, sizeof(row.sensorID), "%s", p->key);
+            memcpy(row.date_time, p->agg.date_time, sizeof(row.date_time));
+            row.rxtime = p->agg.rxtime;
+            aggTake(p, &row);
+            recordRow(p, &row);
+        };
+    };
+    policyFlush(p->rptr, now, all);
+};
+
+static void policyTimer(void *arg) {
+    policyFlush(sensors, time(NULL), false);
+};
+
+// If aggregating, check for quiet sensors' windows every POL_FLUSH sec
+void policyOpen(void) {
+    if (aggregate != AGG_OFF) evTimer(mainLoop, POL_FLUSH*1000, true, policyTimer, NULL);
+};
+
+// Record the windows still open when WDL_433 stops
+void policyClose(void) {
+    if (aggregate != AGG_OFF) policyFlush(sensors, time(NULL), true);
+};
+
+// List the policies, for the debugging output
+void policyPrint(void) {
+    policy_t *p = dflt;
+    printf("Recording policies (min, max sec; temp, rh, press, light deadbands; -1: the default's):\n");
+    do {
+        printf("\t%-24s %6d %6d", (p->name != NULL) ? p->name : "default", p->min, p->max);
+        for (int b = 0; b < POL_BANDS; b++) printf(" %6.1f", p->band[b]);
+        printf("\n");
+        p = (p == dflt) ? policies : p->next;
+    } while (p != NULL);
+};
@@ -23,14 +23,28 @@ extern source_t source;
 extern char    *host;
 extern int      port;
 extern char    *topic;
-#ifdef USE_SQLITE3
+extern double   lagBudget;
+extern char    *stateFile;
+extern char    *spoolFile;
+extern char    *pubTopic;
+extern char    *models;
+extern char    *noModels;
+extern char    *shareGroup;
+extern char    *instance;
+extern char    *captureDir;
+extern char    *captureKeep;
+extern aggregate_t aggregate;
+extern char    *httpAddr;
+extern char    *viewDir;
+extern char    *latestName;
+extern bool     importMode;
+extern char    *backend;
 extern char    *sql3path;
 extern char    *sql3file;
-#else
 extern char    *myHost;
 extern char    *myUser;
 extern char    *myPass;
-#endif
+extern char    *dataFile;
 bool isnumeric(char *str) {
     while (*str!=0) if (!isdigit(*str++)) return(false);
     return(true);
@@ -41,12 +55,16 @@ void strLower(char* s) {
   for(char *p=s; *p; p++) *p=tolower(*p);
 }
 
+// '--debug' enables debug logging for all modules but GetSetParams()
 void setDebug(void) {
     DEBUG = true;
+    for (int m = 0; m < LM_COUNT; m++)
+        if (m != LM_PARAMS) logLevel[m] = LV_DEBUG;
 };
 
 void setGDebug(void) {
     GDEBUG = true;
+    logLevel[LM_PARAMS] = LV_DEBUG;
 };
 
 void helper(cmdlist_t *cmdlist) {
@@ -65,16 +83,31 @@ void setSource(char *optarg) {
     strLower(optarg);
     if (strcmp(optarg, "mqtt")==0) source = MQTT;
     else if
-        (strcmp(optarg, "http")==0) source = HTTP;
+        (strcmp(optarg, "udp")==0) source = UDP;
+    else if
+        (strcmp(optarg, "stdin")==0) source = STDIN;
     else {
         fprintf(stderr, "Invalid source protocol %s specified for '--source' option\n", optarg);
         exit(1);
     };
 };
 
+void setAggregate(char *optarg) {
+    strLower(optarg);
+    if (strcmp(optarg, "off")==0) aggregate = AGG_OFF;
+    else if
+        (strcmp(optarg, "mean")==0) aggregate = AGG_MEAN;
+    else if
+        (strcmp(optarg, "minmax")==0) aggregate = AGG_MINMAX;
+    else {
+        fprintf(stderr, "Invalid aggregation %s specified for '--aggregate' option\n", optarg);
+        exit(1);
+    };
+};
+
 void setHost(char *optarg) {
     char *newHost;
-    if ( (newHost=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newHost=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -94,7 +127,7 @@ void setPort(char *optarg) {
 
 void setTopic(char *optarg) {
     char *newTopic;
-    if ( (newTopic=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newTopic=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -103,10 +136,168 @@ void setTopic(char *optarg) {
     return;
 };
 
-#ifdef USE_SQLITE3
+void setLagBudget(char *optarg) {
+    char *end;
+    double budget = strtod(optarg, &end);
+    if ( (*end != '\0') || (budget < 0) ) {
+        fprintf(stderr, "--lagbudget option '%s' is not a number of seconds\n", optarg);
+        exit(1);
+    };
+    lagBudget = budget;
+    return;
+};
+
+void setStateFile(char *optarg) {
+    char *newFile;
+    if ( (newFile=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newFile, optarg);
+    stateFile = newFile;
+    return;
+};
+
+void setSpoolFile(char *optarg) {
+    char *newFile;
+    if ( (newFile=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newFile, optarg);
+    spoolFile = newFile;
+    return;
+};
+
+void setModels(char *optarg) {
+    char *newModels;
+    if ( (newModels=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newModels, optarg);
+    models = newModels;
+    return;
+};
+
+void setNoModels(char *optarg) {
+    char *newModels;
+    if ( (newModels=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newModels, optarg);
+    noModels = newModels;
+    return;
+};
+
+void setShareGroup(char *optarg) {
+    char *newGroup;
+    if ( (newGroup=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newGroup, optarg);
+    shareGroup = newGroup;
+    return;
+};
+
+void setInstance(char *optarg) {
+    char *newInstance;
+    if ( (newInstance=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newInstance, optarg);
+    instance = newInstance;
+    return;
+};
+
+void setCaptureDir(char *optarg) {
+    char *newDir;
+    if ( (newDir=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newDir, optarg);
+    captureDir = newDir;
+    return;
+};
+
+void setCaptureKeep(char *optarg) {
+    char *newKeep;
+    if ( (newKeep=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newKeep, optarg);
+    captureKeep = newKeep;
+    return;
+};
+
+void setImport(void) {
+    importMode = true;
+    return;
+};
+
+void setPubTopic(char *optarg) {
+    char *newTopic;
+    if ( (newTopic=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newTopic, optarg);
+    pubTopic = newTopic;
+    return;
+};
+
+void setHttp(char *optarg) {
+    char *newAddr;
+    if ( (newAddr=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newAddr, optarg);
+    httpAddr = newAddr;
+    return;
+};
+
+void setViewDir(char *optarg) {
+    char *newDir;
+    if ( (newDir=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newDir, optarg);
+    viewDir = newDir;
+    return;
+};
+
+void setLatest(char *optarg) {
+    char *newName;
+    if ( (newName=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newName, optarg);
+    latestName = newName;
+    return;
+};
+
+void setBackend(char *optarg) {
+    char *newBackend;
+    if ( (newBackend=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newBackend, optarg);
+    backend = newBackend;
+    return;
+};
+
 void setSql3path(char *optarg) {
     char *newPath;
-    if ( (newPath=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newPath=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -117,7 +308,7 @@ void setSql3path(char *optarg) {
 
 void setSql3file(char *optarg) {
     char *newFile;
-    if ( (newFile=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newFile=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -126,10 +317,9 @@ void setSql3file(char *optarg) {
     return;
 };
 
-#else
 void setMyHost(char *optarg) {
     char *newHost;
-    if ( (newHost=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newHost=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -140,7 +330,7 @@ void setMyHost(char *optarg) {
 
 void setMyUser(char *optarg) {
     char *newUser;
-    if ( (newUser=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newUser=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "'setMyUser' unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -151,7 +341,7 @@ void setMyUser(char *optarg) {
 
 void setMyPass(char *optarg) {
     char *newPass;
-    if ( (newPass=malloc(strlen(optarg)) ) == NULL ) {
+    if ( (newPass=malloc(strlen(optarg)+1) ) == NULL ) {
         fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
         exit(1);
     };
@@ -159,24 +349,51 @@ void setMyPass(char *optarg) {
     myPass = newPass;
     return;
 };
-#endif
+
+void setDataFile(char *optarg) {
+    char *newFile;
+    if ( (newFile=malloc(strlen(optarg)+1) ) == NULL ) {
+        fprintf(stderr, "Unable to allocate memory for option '%s' string\n", optarg);
+        exit(1);
+    };
+    strcpy(newFile, optarg);
+    dataFile = newFile;
+    return;
+};
 
 void PrintParams(cmdlist_t *cmdlist, char *header) {
     printf("\n%s\n", header);
     printf("DEBUG    = %s\n", DEBUG ? "true" : "false");
     printf("GDEBUG   = %s\n", GDEBUG ? "true" : "false");
-    printf("source   = %s\n", source ? "MQTT" : "HTTP");
+    printf("source   = %s\n", (source == MQTT) ? "MQTT" :
+                              (source == UDP)  ? "UDP"  :
+                              (source == STDIN) ? "STDIN" : "HTTP");
     printf("host     = %s\n", host);
     printf("port     = %d\n", port);
     printf("topic    = %s\n", topic);
-#ifdef USE_SQLITE3
+    printf("models   = %s\n", models);
+    printf("nomodels = %s\n", noModels);
+    printf("share    = %s\n", shareGroup);
+    printf("instance = %s\n", instance);
+    printf("pubtopic = %s\n", pubTopic);
+    printf("aggregate= %s\n", (aggregate == AGG_MEAN)   ? "mean" :
+                              (aggregate == AGG_MINMAX) ? "minmax" : "off");
+    printf("http     = %s\n", httpAddr);
+    printf("viewdir  = %s\n", viewDir);
+    printf("latest   = %s\n", latestName);
+    printf("lagbudget= %.1f sec\n", lagBudget);
+    printf("statefile= %s\n", stateFile);
+    printf("spoolfile= %s\n", spoolFile);
+    printf("capturedir= %s\n", captureDir);
+    printf("capturekeep=%s\n", captureKeep);
+    logPrintLevels();
+    printf("backend  = %s\n", backend);
     printf("sql3path = %s\n", sql3path);
     printf("sql3file = %s\n", sql3file);
-#else
     printf("myHost   = %s\n", myHost);
     printf("myUser   = %s\n", myUser);
     printf("myPass   = %s\n", myPass);
-#endif
+    printf("datafile = %s\n", dataFile);
     printf("\n");
     return;
 };
@@ -202,7 +419,8 @@ void PrintParams(cmdlist_t *cmdlist, char *header) {
      "node_find" returns the pointer to the node:
      -  either a pointer to a previously-created node or (if 'create' = true)
         a pointer to a newly-created node with the keyword embedded in it,
-        its 'alias' pointer set to NULL, and the timestamp set to 0
+        its 'alias' pointer set by the first [aliases] pattern it matches, if
+        any (else NULL), and the timestamp set to 0
      -  NULL if the keyword isn't in the tree and 'create' is false
      In creating a new node to add a new key to the tree,
      "node_find()" COPIES the key into a dynamically-allocated string
@@ -222,7 +440,7 @@ void PrintParams(cmdlist_t *cmdlist, char *header) {
 //  create a new binary tree node and initialize its data values (lastTime, alias)
 NPTR node_new(char *key) {
     NPTR p;
-    if (DEBUG) printf("Entering node_new with key '%s' to create node\n", key);
+    LOG(LM_MAIN, LV_DEBUG, "Entering node_new with key '%s' to create node\n", key);
     p = (NPTR) malloc(sizeof(NODE));
     if (p == NULL) {
         fprintf(stderr, "Out of memory allocating space for a new binary tree node in 'bintree'\n");
@@ -230,8 +448,12 @@ NPTR node_new(char *key) {
     };
     p->key = (char *) malloc(strlen(key)+1);
     strcpy(p->key,key);
-    p->alias    = NULL;
+    p->alias    = aliasMatch(key);   // by the [aliases] patterns; its own entry overrides
     p->lasttime = 0x00000000;
+    p->policy   = NULL;
+    p->haveLast = false;
+    p->agg.count = 0;
+    memset(&p->lag, 0, sizeof(p->lag));
     p->lptr     = p->rptr    = NULL;
     return p;
 };
@@ -0,0 +1,89 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_publish.c
+    Republishing of accepted readings for WDL_433, weather data logger
+    for rtl_433
+
+    rtl_433 publishes each reading several times; WDL_433 records it
+    once, under its alias.  If 'pubtopic' is set (e.g. 'ws433'), each
+    reading WDL_433 records is also published, once, on the MQTT
+    connection it receives packets on, to
+        <pubtopic>/<sensor>/reading
+    where <sensor> is the alias, or the model/id/channel sensorID with
+    '/' replaced by '_'.  The payload is a compact JSON object with the
+    database's fields, rounded as they are recorded:
+        {"date_time":"2025-07-01 12:00:00","sensorID":"Deck",
+         "temp1":21.3,"temp2":0.0,"rh":45,"press":0.0,"light":0}
+    Messages are retained, so a client that subscribes to
+    '<pubtopic>/+/reading' is sent the latest reading from every sensor
+    at once.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <mosquitto.h>
+
+#include "WDL_433.h"
+
+extern source_t source;
+extern char    *pubTopic;
+extern struct mosquitto *mosq;
+
+#define PUB_QOS   0
+#define PUB_TOPIC (FNLEN+64)      // longest topic published
+#define PUB_LEN   512             // longest payload published
+
+// Publishing needs the MQTT connection packets are received on
+void publishInit(void) {
+    if ( (pubTopic == NULL) || (*pubTopic == '\0') ) return;
+    if (source != MQTT) {
+        fprintf(stderr, "?WDL_433: 'pubtopic' needs 'source = MQTT'\n");
+        exit(EXIT_FAILURE);
+    };
+    LOG(LM_PUB, LV_DEBUG, "Publishing readings to '%s/<sensor>/reading'\n", pubTopic);
+};
+
+// Copy 's' to 'out' (of 'size' bytes) as the inside of a JSON string:
+//   '"' and '\' escaped, control characters as \u00xx
+static void jsonString(char *out, size_t size, const char *s) {
+    size_t len = 0;
+    for (; (*s != '\0') && (len + 7 < size); s++)
+        if ( (*s == '"') || (*s == '\\') ) len += snprintf(out+len, size-len, "\\%c", *s);
+        else if ((unsigned char)*s < ' ')  len += snprintf(out+len, size-len, "\\u%04x", *s);
+        else                               out[len++] = *s;
+    out[len] = '\0';
+};
+
+// Publish a reading that has been accepted for recording
+void publishRecord(DBRecord *DBRow) {
+    char topic[PUB_TOPIC], payload[PUB_LEN], sensorID[6*sizeof(DBRow->sensorID)], *s;
+    int  n, len, rc;
+
+    if ( (pubTopic == NULL) || (*pubTopic == '\0') || (mosq == NULL) ) return;
+
+    // One topic level per sensor: no separators or wildcards in it
+    n = snprintf(topic, sizeof(topic), "%s/", pubTopic);
+    len = strlen(DBRow->sensorID);
+    while ( (len > 0) && (DBRow->sensorID[len-1] == '/') ) len--;
+    snprintf(topic+n, sizeof(topic)-n, "%.*s/reading", len, DBRow->sensorID);
+    for (s = topic+n; *s != '\0' && s < topic+n+len; s++)
+        if ( (*s == '/') || (*s == '+') || (*s == '#') ) *s = '_';
+
+    jsonString(sensorID, sizeof(sensorID), DBRow->sensorID);
+    len = snprintf(payload, sizeof(payload),
+                   "{\"date_time\":\"%s\",\"sensorID\":\"%s\",\"temp1\":%.1f,\"temp2\":%.1f,"
+                   "\"rh\":%.0f,\"press\":%.1f,\"light\":%.0f}",
+                   DBRow->date_time, sensorID, DBRow->temp1, DBRow->temp2,
+                   round(DBRow->rh), DBRow->press, round(DBRow->light));
+    if (len >= (int)sizeof(payload)) {
+        LOG(LM_PUB, LV_WARN, "Reading of sensor %s too long to publish\n", DBRow->sensorID);
+        return;
+    };
+    rc = mosquitto_publish(mosq, NULL, topic, len, payload, PUB_QOS, true);
+    if (rc != MOSQ_ERR_SUCCESS)
+        LOG(LM_PUB, LV_DEBUG, "Can't publish to '%s': %s\n", topic, mosquitto_strerror(rc));
+};
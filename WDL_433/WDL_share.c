@@ -0,0 +1,217 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_share.c
+    Sharing one rtl_433 feed among several WDL_433 instances
+
+    If 'share' names a group, each instance in the group subscribes to
+    its topic filters as an MQTT v5 shared subscription,
+    '$share/<group>/<filter>', so the broker delivers each packet to
+    just one of them.  The broker chooses the instance without regard
+    to the sensor, but de-duplication and the recording interval need
+    every packet from a sensor to be processed by the same instance.
+    So each sensor is owned by one instance, chosen by rendezvous
+    hashing: the live instance 'i' with the highest hash of i+sensorID.
+    An instance that receives a packet from a sensor it doesn't own
+    forwards it, unparsed, to the owner's own topic.
+
+    Instances find each other through retained messages:
+        WDL_433/<group>/up/<instance>    "1" while 'instance' is connected;
+                                         cleared by its will if it stops
+        WDL_433/<group>/to/<instance>    packets forwarded to 'instance'
+    When an instance joins or leaves, only the sensors it owns (or now
+    owns) move.  A packet forwarded to an instance is always processed
+    there, even if the two momentarily disagree about who owns it, so
+    packets are never forwarded twice.
+
+    'instance' defaults to the host name, so instances on the same host
+    must each be given their own.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+#include <mosquitto.h>
+
+#include "WDL_433.h"
+
+extern char *shareGroup;
+extern char *instance;
+extern struct mosquitto *mosq;
+
+#define SHARE_PREFIX "WDL_433"
+#define SHARE_MAX    64           // most instances in a group
+#define DISCONNECT_WITH_WILL 0x04 // MQTT v5 DISCONNECT reason code
+
+static char  *peers[SHARE_MAX];   // live instances, including this one
+static int    npeers = 0;
+static char  *upTopic = NULL;     // SHARE_PREFIX/<group>/up/<instance>
+static char  *toTopic = NULL;     // SHARE_PREFIX/<group>/to/<instance>
+static size_t prefixLen;          // length of SHARE_PREFIX/<group>/
+static bool   direct = false;     // processing a packet forwarded to us
+
+static char *shareName(const char *kind, const char *name) {
+    char  *s;
+    size_t len = strlen(SHARE_PREFIX) + strlen(shareGroup) + strlen(kind) + strlen(name) + 4;
+    if ( (s = malloc(len)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for shared subscription topics\n");
+        exit(EXIT_FAILURE);
+    };
+    snprintf(s, len, "%s/%s/%s/%s", SHARE_PREFIX, shareGroup, kind, name);
+    return s;
+};
+
+bool shareActive(void) {
+    return (shareGroup != NULL) && (*shareGroup != '\0');
+};
+
+// 64-bit FNV-1a of 'a' and 'b', finished with the splitmix64 mixer
+static uint64_t shareHash(const char *a, const char *b) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *a != '\0'; a++) h = (h ^ (uint8_t)*a) * 0x100000001b3ULL;
+    h = (h ^ '/') * 0x100000001b3ULL;
+    for (; *b != '\0'; b++) h = (h ^ (uint8_t)*b) * 0x100000001b3ULL;
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+};
+
+// The live instance that owns 'sensorID'
+static char *shareOwner(const char *sensorID) {
+    char    *owner = peers[0];
+    uint64_t best  = shareHash(peers[0], sensorID), h;
+    for (int i = 1; i < npeers; i++)
+        if ( (h = shareHash(peers[i], sensorID)) > best ) {
+            best  = h;
+            owner = peers[i];
+        };
+    return owner;
+};
+
+static void peerUp(const char *name) {
+    for (int i = 0; i < npeers; i++)
+        if (strcmp(peers[i], name) == 0) return;
+    if (npeers == SHARE_MAX) {
+        LOG(LM_MAIN, LV_WARN, "Too many instances in group '%s': ignoring '%s'\n",
+            shareGroup, name);
+        return;
+    };
+    peers[npeers++] = strdup(name);
+    LOG(LM_MAIN, LV_INFO, "Instance '%s' joined group '%s': %d instances\n",
+        name, shareGroup, npeers);
+};
+
+static void peerDown(const char *name) {
+    if (strcmp(name, instance) == 0) return;    // we're still here
+    for (int i = 0; i < npeers; i++)
+        if (strcmp(peers[i], name) == 0) {
+            free(peers[i]);
+            peers[i] = peers[--npeers];
+            LOG(LM_MAIN, LV_INFO, "Instance '%s' left group '%s': %d instances\n",
+                name, shareGroup, npeers);
+            return;
+        };
+};
+
+// Set up the client for the group before it connects: MQTT v5, for
+//   shared subscriptions, and a will that clears our 'up' message
+void shareOpen(struct mosquitto *mosq) {
+    char name[HOST_NAME_MAX+1];
+    if (!shareActive()) return;
+    if ( (instance == NULL) || (*instance == '\0') ) {
+        if (gethostname(name, sizeof(name)) != 0) strcpy(name, "WDL_433");
+        name[HOST_NAME_MAX] = '\0';
+        instance = strdup(name);
+    };
+    if (strpbrk(instance, "/+#") != NULL || strpbrk(shareGroup, "/+#") != NULL) {
+        fprintf(stderr, "?WDL_433: 'share' and 'instance' can't contain '/', '+' or '#'\n");
+        exit(EXIT_FAILURE);
+    };
+    upTopic   = shareName("up", instance);
+    toTopic   = shareName("to", instance);
+    prefixLen = strlen(SHARE_PREFIX) + strlen(shareGroup) + 2;
+    peerUp(instance);
+    mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    if (mosquitto_will_set(mosq, upTopic, 0, NULL, 1, true) != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "?WDL_433: Can't set MQTT will for shared subscriptions\n");
+        exit(EXIT_FAILURE);
+    };
+    LOG(LM_MAIN, LV_DEBUG, "Sharing as instance '%s' of group '%s'\n", instance, shareGroup);
+};
+
+// The shared form of topic filter 'filter'
+char *shareFilter(char *filter) {
+    char  *s;
+    size_t len;
+    if (!shareActive()) return filter;
+    len = strlen(shareGroup) + strlen(filter) + 9;
+    if ( (s = malloc(len)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for shared subscription topics\n");
+        exit(EXIT_FAILURE);
+    };
+    snprintf(s, len, "$share/%s/%s", shareGroup, filter);
+    return s;
+};
+
+// (Re)connected: announce ourselves and listen for the others and for
+//   packets forwarded to us
+bool shareConnected(struct mosquitto *mosq) {
+    char *peersTopic;
+    int   rc;
+    if (!shareActive()) return true;
+    peersTopic = shareName("up", "+");
+    rc = mosquitto_subscribe(mosq, NULL, peersTopic, 1);
+    if (rc == MOSQ_ERR_SUCCESS) rc = mosquitto_subscribe(mosq, NULL, toTopic, 0);
+    if (rc == MOSQ_ERR_SUCCESS) rc = mosquitto_publish(mosq, NULL, upTopic, 1, "1", 1, true);
+    free(peersTopic);
+    return rc == MOSQ_ERR_SUCCESS;
+};
+
+// Handle a message about the group or forwarded to us; false if it's
+//   an ordinary packet
+bool shareMessage(const struct mosquitto_message *message) {
+    const char *t = message->topic;
+    if ( !shareActive() || (strncmp(t, upTopic, prefixLen) != 0) ) return false;
+    t += prefixLen;
+    if (strncmp(t, "up/", 3) == 0) {
+        if (message->payloadlen > 0) peerUp(t+3);
+        else                         peerDown(t+3);
+        return true;
+    };
+    if (strcmp(message->topic, toTopic) == 0) {
+        direct = true;
+        processMessage(message->payload);
+        direct = false;
+        return true;
+    };
+    return false;
+};
+
+// Should this instance process the packet 'payload' from 'sensorID'?
+//   If not, forward it to the instance that should
+bool shareMine(char *sensorID, char *payload) {
+    char *owner, *t;
+    int   rc;
+    if ( !shareActive() || direct || (npeers < 2) ) return true;
+    owner = shareOwner(sensorID);
+    if (strcmp(owner, instance) == 0) return true;
+    t  = shareName("to", owner);
+    rc = mosquitto_publish(mosq, NULL, t, strlen(payload), payload, 0, false);
+    if (rc != MOSQ_ERR_SUCCESS)
+        LOG(LM_MAIN, LV_WARN, "Can't forward packet from %s to instance '%s': %s\n",
+            sensorID, owner, mosquitto_strerror(rc));
+    else
+        LOG(LM_MAIN, LV_DEBUG, "Forwarded packet from %s to instance '%s'\n", sensorID, owner);
+    free(t);
+    return false;
+};
+
+// Leave the group: disconnecting this way has the broker publish our will
+void shareClose(struct mosquitto *mosq) {
+    if (shareActive()) mosquitto_disconnect_v5(mosq, DISCONNECT_WITH_WILL, NULL);
+};
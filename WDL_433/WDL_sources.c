@@ -0,0 +1,416 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_sources.c
+    Packet sources for WDL_433, weather data logger for rtl_433
+
+    Each source delivers rtl_433 JSON packets to processMessage()
+    from the main event loop:
+      MQTT   subscribes to 'topic' on the MQTT server 'host':'port'.
+             If 'models' or 'nomodels' is set, rtl_433 must publish
+             each device's events under its model, e.g. with
+             '-F mqtt://host,events=rtl_433/[hostname]/events[/model]',
+             and WDL_433 subscribes to 'topic'/<model>/# for each model
+             in 'models' that isn't in 'nomodels', so the broker never
+             sends it the others (or to 'topic'/# if only 'nomodels' is
+             set: MQTT can't exclude a topic, so those are dropped
+             here, before they are parsed).
+             If 'share' is set, the filters are shared among the
+             instances in that group (see WDL_share.c).
+             The mosquitto client is driven through its socket:
+             mosquitto_loop_read()/_write() when the socket is ready,
+             mosquitto_loop_misc() from a 1-sec timer for keepalives,
+             and mosquitto_reconnect() from a timer, with increasing
+             delays, if the connection is lost.
+      UDP    receives datagrams on 'host':'port', as sent by rtl_433
+             with '-F syslog:<host>:<port>'; the JSON packet follows
+             the syslog header.
+      STDIN  reads one JSON packet per line from standard input, as
+             written by 'rtl_433 -F json'; WDL_433 stops at end of file.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <mosquitto.h>
+
+#include "WDL_433.h"
+
+extern bool     DEBUG;
+extern source_t source;
+extern char    *host;
+extern int      port;
+extern char    *topic;
+extern char    *models;
+extern char    *noModels;
+extern char    *shareGroup;
+
+struct mosquitto *mosq = NULL;
+
+#define KEEPALIVE     60          // MQTT keepalive, sec
+#define RECONNECT_MIN 1000        // first MQTT reconnect delay, msec
+#define RECONNECT_MAX 60000       // longest MQTT reconnect delay, msec
+#define MAXPACKET     4096        // longest UDP or stdin packet
+#define STDIN_BUDGET  (1<<20)     // bytes of a stdin file read per timer tick
+
+static int  stdinTimer = 0;       // timer for reading stdin from a file
+static int  mqttFd    = -1;       // socket being watched, or -1
+static bool mqttWrite = false;    // watching for EPOLLOUT
+static long mqttDelay = RECONNECT_MIN;
+
+static char **allow = NULL, **deny = NULL;   // model lists
+static int    nallow = 0, ndeny = 0;
+static char **filters = NULL;     // topic filters subscribed to
+static int    nfilters = 0;
+static int    modelLevel = -1;    // topic level holding the model, or -1
+
+static void mqttLost(int rc);
+
+// Split a comma-separated list of model names into '*names'; returns the count
+static int modelList(char *list, char ***names) {
+    char *copy, *name, *save;
+    int   n = 0;
+    if ( (list == NULL) || (*list == '\0') ) return 0;
+    if ( (copy = strdup(list)) == NULL ) return 0;
+    for (name = strtok_r(copy, ", \t", &save); name != NULL; name = strtok_r(NULL, ", \t", &save)) {
+        if (strpbrk(name, "/+#") != NULL) {
+            fprintf(stderr, "?WDL_433: model '%s' can't contain '/', '+' or '#'\n", name);
+            exit(EXIT_FAILURE);
+        };
+        if ( (*names = realloc(*names, (n+1)*sizeof(char *))) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for model list\n");
+            exit(EXIT_FAILURE);
+        };
+        (*names)[n++] = name;     // points into 'copy', which is kept
+    };
+    return n;
+};
+
+static bool modelIn(const char *model, char **names, int n) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(model, names[i]) == 0) return true;
+    return false;
+};
+
+// Should messages from 'model' be processed?
+static bool modelWanted(const char *model) {
+    if ( (nallow > 0) && !modelIn(model, allow, nallow) ) return false;
+    return !modelIn(model, deny, ndeny);
+};
+
+// Subscribe to everything under 'topic'/'model' (or under 'topic' if 'model' is NULL)
+static void addFilter(const char *model) {
+    char *f;
+    size_t len = strlen(topic) + ((model == NULL) ? 0 : strlen(model)) + 4;
+    if ( (filters = realloc(filters, (nfilters+1)*sizeof(char *))) == NULL
+         || (f = malloc(len)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for MQTT topic filters\n");
+        exit(EXIT_FAILURE);
+    };
+    if (model == NULL)
+        snprintf(f, len, "%s/#", topic);
+    else
+        snprintf(f, len, "%s/%s/#", topic, model);
+    filters[nfilters++] = f;
+};
+
+// Work out the fewest topic filters that deliver the models wanted:
+//   one per model allowed and not denied, or everything under 'topic'
+//   if only some are denied, or just 'topic' if none are selected
+static void mqttFilters(void) {
+    char *model;
+    nallow = modelList(models, &allow);
+    ndeny  = modelList(noModels, &deny);
+    if ( (nallow == 0) && (ndeny == 0) ) {
+        filters = &topic;
+        nfilters = 1;
+        return;
+    };
+    if ( (strlen(topic) > 0) && (topic[strlen(topic)-1] == '#') ) {
+        fprintf(stderr, "?WDL_433: with 'models' or 'nomodels', 'topic' must be the prefix "
+                "of the per-model topics, not end in '#'\n");
+        exit(EXIT_FAILURE);
+    };
+    modelLevel = 1;
+    for (char *s = topic; *s != '\0'; s++)
+        if (*s == '/') modelLevel++;
+    if (nallow == 0) {
+        addFilter(NULL);
+        return;
+    };
+    for (int i = 0; i < nallow; i++) {
+        model = allow[i];
+        if ( modelIn(model, deny, ndeny) || modelIn(model, allow, i) ) continue;
+        addFilter(model);
+    };
+    if (nfilters == 0) {
+        fprintf(stderr, "?WDL_433: every model in 'models' is also in 'nomodels'\n");
+        exit(EXIT_FAILURE);
+    };
+};
+
+// Find level 'level' of 'topic', copying it to 'buf'; false if there isn't one
+static bool topicLevel(const char *t, int level, char *buf, size_t len) {
+    const char *end;
+    while ( (level-- > 0) && (t = strchr(t, '/')) != NULL ) t++;
+    if (t == NULL) return false;
+    end = strchr(t, '/');
+    snprintf(buf, len, "%.*s", (int)((end == NULL) ? strlen(t) : (size_t)(end - t)), t);
+    return true;
+};
+
+// This is called when the MQTT connection to the server has been made or
+//   re-established.  It subscribes or re-subscribes to the topic so that
+//   messages will be received and processed by the message callback routine..
+static void connect_callback(struct mosquitto *mosq, void *obj, int connack_code) {
+    LOG(LM_MAIN, LV_DEBUG, "MQTT connect callback, result code = %d\n", connack_code);
+    LOG(LM_MAIN, LV_DEBUG, "MQTT result msg: %s\n", mosquitto_connack_string(connack_code));
+    if (connack_code >= 0x80) {
+        fprintf(stderr,"MQTT connection failed with error code %d!\n", connack_code);
+        exit(EXIT_FAILURE);
+    }
+    int rc = mosquitto_subscribe_multiple(mosq, NULL, nfilters, filters, 0, 0, NULL);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "?Couldn't subscribe to MQTT server '%s', port %d, topic '%s'%s\n",
+                host, port, filters[0], (nfilters > 1) ? " etc." : "");
+        fprintf(stderr, "Subscription error code %d, \n   %s\n",
+                rc, mosquitto_reason_string(rc));
+        fprintf(stderr, "Verify that the topic and port are correct\n");
+        exit(EXIT_FAILURE);
+    };
+    if (!shareConnected(mosq)) {
+        fprintf(stderr, "?Couldn't join group '%s' on MQTT server '%s'\n", shareGroup, host);
+        exit(EXIT_FAILURE);
+    };
+    mqttDelay = RECONNECT_MIN;
+};
+
+// libmosquitto NUL-terminates the payload, so it can be processed as a string
+// Messages from models that aren't wanted are dropped before they are parsed
+static void message_callback(struct mosquitto *mosq, void *obj,
+                             const struct mosquitto_message *message) {
+    char model[64];
+    if (shareMessage(message)) return;
+    if ( (modelLevel >= 0)
+         && (!topicLevel(message->topic, modelLevel, model, sizeof(model)) || !modelWanted(model)) )
+        return;
+    processMessage(message->payload);
+};
+
+// The MQTT socket is ready for reading or writing
+static void mqttEvent(int fd, uint32_t events, void *arg) {
+    int rc = MOSQ_ERR_SUCCESS;
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        rc = mosquitto_loop_read(mosq, 1);
+    if ( (rc == MOSQ_ERR_SUCCESS) && (events & EPOLLOUT) )
+        rc = mosquitto_loop_write(mosq, 1);
+    if (rc != MOSQ_ERR_SUCCESS) mqttLost(rc);
+};
+
+// Before the loop waits, watch for EPOLLOUT only if mosquitto has data to send
+static void mqttIdle(void *arg) {
+    bool want;
+    if (mqttFd < 0) return;
+    want = mosquitto_want_write(mosq);
+    if (want != mqttWrite) {
+        evModFd(mainLoop, mqttFd, EPOLLIN | (want ? EPOLLOUT : 0));
+        mqttWrite = want;
+    };
+};
+
+// Start watching the socket of a new connection
+static bool mqttWatch(void) {
+    mqttFd = mosquitto_socket(mosq);
+    if (mqttFd < 0) return false;
+    mqttWrite = false;
+    return evAddFd(mainLoop, mqttFd, EPOLLIN, mqttEvent, NULL);
+};
+
+static void mqttReconnect(void *arg) {
+    int rc = mosquitto_reconnect(mosq);
+    if ( (rc == MOSQ_ERR_SUCCESS) && mqttWatch() ) {
+        LOG(LM_MAIN, LV_INFO, "Reconnected to MQTT server '%s'\n", host);
+        return;
+    };
+    mqttLost(rc);
+};
+
+// The connection was lost: stop watching it and try again later
+static void mqttLost(int rc) {
+    if (mqttFd >= 0) {
+        LOG(LM_MAIN, LV_WARN, "Lost connection to MQTT server '%s': %s\n",
+            host, mosquitto_strerror(rc));
+        evDelFd(mainLoop, mqttFd);
+        mqttFd = -1;
+    };
+    LOG(LM_MAIN, LV_DEBUG, "Reconnecting to MQTT server in %ld msec\n", mqttDelay);
+    evTimer(mainLoop, mqttDelay, false, mqttReconnect, NULL);
+    mqttDelay = (2*mqttDelay > RECONNECT_MAX) ? RECONNECT_MAX : 2*mqttDelay;
+};
+
+// Keepalive pings and retries of in-flight messages
+static void mqttMisc(void *arg) {
+    if (mqttFd < 0) return;
+    int rc = mosquitto_loop_misc(mosq);
+    if (rc != MOSQ_ERR_SUCCESS) mqttLost(rc);
+};
+
+static void mqttOpen(void) {
+    char clientid[24];
+    int  rc;
+
+    if (DEBUG) printf("Opening MQTT connection & subscribing\n"
+                      "Host: %s, port %d, topic: %s\n",
+                      host, port, topic);
+    mqttFilters();
+    for (int i = 0; i < nfilters; i++) filters[i] = shareFilter(filters[i]);
+    for (int i = 0; i < nfilters; i++)
+        LOG(LM_MAIN, LV_DEBUG, "MQTT topic filter: '%s'\n", filters[i]);
+    mosquitto_lib_init();
+    snprintf(clientid, sizeof(clientid), "WDL_433_%d", getpid());
+    mosq = mosquitto_new(clientid, true, 0);
+    if (mosq == NULL) {
+        fprintf(stderr, "?WDL_433: Unable to create mosquitto client\n");
+        exit(EXIT_FAILURE);
+    };
+
+    //  Connect to the MQTT feed and subscribe in connect_callback
+    if (DEBUG) printf("Subscribing to MQTT feed\n");
+    shareOpen(mosq);
+    mosquitto_connect_callback_set(mosq, connect_callback);
+    mosquitto_message_callback_set(mosq, message_callback);
+    rc = mosquitto_connect(mosq, host, port, KEEPALIVE);
+    if ( (rc != MOSQ_ERR_SUCCESS) || !mqttWatch() ) {
+        fprintf(stderr, "?WDL_433: Couldn't connect to MQTT server\n");
+        fprintf(stderr, "Verify that host '%s' is publishing MQTT on port %d,\n",
+                host, port);
+        exit(EXIT_FAILURE);
+    };
+    evIdle(mainLoop, mqttIdle, NULL);
+    evTimer(mainLoop, 1000, true, mqttMisc, NULL);
+};
+
+// A UDP datagram has arrived: process the JSON after the syslog header
+static void udpEvent(int fd, uint32_t events, void *arg) {
+    char buf[MAXPACKET+1], *json;
+    ssize_t n;
+    while ( (n = recv(fd, buf, MAXPACKET, MSG_DONTWAIT)) > 0 ) {
+        buf[n] = '\0';
+        if ( (json = strchr(buf, '{')) != NULL ) processMessage(json);
+    };
+};
+
+static void udpOpen(void) {
+    struct addrinfo hints, *ai;
+    char service[16];
+    int  fd, rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_PASSIVE;
+    snprintf(service, sizeof(service), "%d", port);
+    rc = getaddrinfo( (*host == '\0') ? NULL : host, service, &hints, &ai);
+    if (rc != 0) {
+        fprintf(stderr, "?WDL_433: Can't resolve UDP address '%s': %s\n",
+                host, gai_strerror(rc));
+        exit(EXIT_FAILURE);
+    };
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if ( (fd < 0) || (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) ) {
+        fprintf(stderr, "?WDL_433: Can't receive UDP on '%s' port %d: %s\n",
+                host, port, strerror(errno));
+        exit(EXIT_FAILURE);
+    };
+    freeaddrinfo(ai);
+    evAddFd(mainLoop, fd, EPOLLIN, udpEvent, NULL);
+};
+
+// Read standard input once and process each complete line; returns the
+//   number of bytes read, 0 at end of input (when reading stops)
+static ssize_t stdinRead(int fd) {
+    static char buf[MAXPACKET+1];
+    static int  len = 0;
+    char *line, *nl;
+    ssize_t n;
+
+    n = read(fd, buf+len, MAXPACKET-len);
+    if ( (n < 0) && (errno == EAGAIN) ) return -1;
+    if (n <= 0) {
+        // End of input: process any last line and stop
+        buf[len] = '\0';
+        if (len > 0) processMessage(buf);
+        if (stdinTimer != 0) evCancel(mainLoop, stdinTimer);
+        else                 evDelFd(mainLoop, fd);
+        stdinTimer = 0;
+        evStop(mainLoop);
+        return 0;
+    };
+    len += n;
+    buf[len] = '\0';
+    line = buf;
+    while ( (nl = strchr(line, '\n')) != NULL ) {
+        *nl = '\0';
+        if (*line == '{') processMessage(line);
+        line = nl+1;
+    };
+    len -= line - buf;
+    memmove(buf, line, len);
+    if (len == MAXPACKET) len = 0;    // line too long: discard it
+    return n;
+};
+
+// Standard input is readable
+static void stdinEvent(int fd, uint32_t events, void *arg) {
+    stdinRead(fd);
+};
+
+// A regular file can't be watched by epoll but is always readable: read
+//   up to STDIN_BUDGET bytes of it each tick, so a file is read at disk
+//   speed but timers and signals are still served between the chunks
+static void stdinFile(void *arg) {
+    ssize_t n, total = 0;
+    while ( (total < STDIN_BUDGET) && ((n = stdinRead(STDIN_FILENO)) > 0) )
+        total += n;
+};
+
+static void stdinOpen(void) {
+    struct stat st;
+    if ( (fstat(STDIN_FILENO, &st) == 0) && S_ISREG(st.st_mode) ) {
+        stdinTimer = evTimer(mainLoop, 1, true, stdinFile, NULL);
+        return;
+    };
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    if (!evAddFd(mainLoop, STDIN_FILENO, EPOLLIN, stdinEvent, NULL)) {
+        fprintf(stderr, "?WDL_433: Can't read packets from standard input\n");
+        exit(EXIT_FAILURE);
+    };
+};
+
+// Open the packet source selected by 'source'
+void sourceOpen(void) {
+    switch (source) {
+    case MQTT:  mqttOpen();  break;
+    case UDP:   udpOpen();   break;
+    case STDIN: stdinOpen(); break;
+    default:
+        fprintf(stderr, "?WDL_433: HTTP source is not supported\n");
+        exit(EXIT_FAILURE);
+    };
+};
+
+void sourceClose(void) {
+    if (mosq == NULL) return;
+    if (shareActive()) shareClose(mosq);
+    else               mosquitto_disconnect(mosq);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+    mosq = NULL;
+};
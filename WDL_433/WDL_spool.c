@@ -0,0 +1,207 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_spool.c
+    Durable on-disk spool of database records for WDL_433
+
+    When the database can't accept records, they are appended to a
+    spool file and replayed, in order, once it can.  The spool file is
+    memory-mapped and consists of a one-page header followed by an
+    array of DBRecords:
+        spoolHdr    magic, record size, and the indices of the first
+                    pending record ('head') and the next free slot ('tail')
+        DBRecord[]  records, in the order they were appended
+    Records are synced to disk before 'tail' is advanced past them, and
+    'head' is advanced only after the records have been committed to
+    the database, so a crash can at worst cause a batch to be replayed
+    twice but never loses records.  When the spool has been emptied,
+    the file is truncated back to its initial size, and once more than
+    half of it has been replayed, the pending records are moved to its
+    start and it's truncated to fit them.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "WDL_433.h"
+
+#define SPOOL_MAGIC   "WDL433Q"
+#define SPOOL_VERSION 1
+#define SPOOL_HDR     4096            // header occupies the first page
+#define SPOOL_GROW    1024            // records added each time the file grows
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recsize;                 // sizeof(DBRecord) when written
+    uint64_t head;                    // index of first pending record
+    uint64_t tail;                    // index of next free record slot
+} spoolHdr;
+
+struct spool {
+    char     *path;
+    int       fd;
+    char     *map;
+    size_t    mapsize;
+    spoolHdr *hdr;
+};
+
+#define SPOOL_REC(sp, i) ((DBRecord *)((sp)->map + SPOOL_HDR) + (i))
+
+static size_t spoolSize(uint64_t nrecs) {
+    return SPOOL_HDR + nrecs*sizeof(DBRecord);
+};
+
+// Resize the file and its mapping to hold 'nrecs' records
+static bool spoolResize(spool_t *sp, uint64_t nrecs) {
+    size_t size = spoolSize(nrecs);
+    char  *map;
+    if (ftruncate(sp->fd, size) != 0) {
+        LOG(LM_SPOOL, LV_ERR, "Can't resize spool file '%s': %s\n", sp->path, strerror(errno));
+        return false;
+    };
+    if (sp->map == NULL)
+        map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, sp->fd, 0);
+    else
+        map = mremap(sp->map, sp->mapsize, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        LOG(LM_SPOOL, LV_ERR, "Can't map spool file '%s': %s\n", sp->path, strerror(errno));
+        return false;
+    };
+    sp->map     = map;
+    sp->mapsize = size;
+    sp->hdr     = (spoolHdr *) map;
+    return true;
+};
+
+static void spoolSyncHdr(spool_t *sp) {
+    msync(sp->map, SPOOL_HDR, MS_SYNC);
+};
+
+spool_t *spoolOpen(char *path) {
+    struct stat st;
+    spool_t *sp;
+
+    if ( (path == NULL) || (*path == '\0') ) return NULL;
+    if ( (sp = calloc(1, sizeof(spool_t))) == NULL ) return NULL;
+    sp->path = strdup(path);
+    if ( (sp->fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644)) < 0 ) {
+        LOG(LM_SPOOL, LV_ERR, "Can't open spool file '%s': %s\n", path, strerror(errno));
+        free(sp->path);
+        free(sp);
+        return NULL;
+    };
+    fstat(sp->fd, &st);
+    if ( (size_t)st.st_size >= SPOOL_HDR ) {
+        // Existing spool: map it and check that it's one of ours
+        if (!spoolResize(sp, (st.st_size - SPOOL_HDR)/sizeof(DBRecord))) goto fail;
+        if ( (memcmp(sp->hdr->magic, SPOOL_MAGIC, sizeof(SPOOL_MAGIC)) != 0)
+             || (sp->hdr->version != SPOOL_VERSION)
+             || (sp->hdr->recsize != sizeof(DBRecord))
+             || (sp->hdr->head > sp->hdr->tail)
+             || (spoolSize(sp->hdr->tail) > sp->mapsize) ) {
+            LOG(LM_SPOOL, LV_ERR, "Spool file '%s' is not valid or is from another "
+                "version of WDL_433: move it aside\n", path);
+            goto fail;
+        };
+        if (sp->hdr->tail > sp->hdr->head)
+            LOG(LM_SPOOL, LV_INFO, "%lu records are spooled in '%s'\n",
+                (unsigned long)(sp->hdr->tail - sp->hdr->head), path);
+        return sp;
+    };
+    // New spool
+    if (!spoolResize(sp, SPOOL_GROW)) goto fail;
+    memset(sp->hdr, 0, sizeof(spoolHdr));
+    memcpy(sp->hdr->magic, SPOOL_MAGIC, sizeof(SPOOL_MAGIC));
+    sp->hdr->version = SPOOL_VERSION;
+    sp->hdr->recsize = sizeof(DBRecord);
+    spoolSyncHdr(sp);
+    return sp;
+
+fail:
+    if (sp->map != NULL) munmap(sp->map, sp->mapsize);
+    close(sp->fd);
+    free(sp->path);
+    free(sp);
+    return NULL;
+};
+
+void spoolClose(spool_t *sp) {
+    if (sp == NULL) return;
+    spoolSyncHdr(sp);
+    munmap(sp->map, sp->mapsize);
+    close(sp->fd);
+    free(sp->path);
+    free(sp);
+};
+
+// Number of records waiting to be replayed
+long spoolCount(spool_t *sp) {
+    return (sp == NULL) ? 0 : (long)(sp->hdr->tail - sp->hdr->head);
+};
+
+// Append 'n' records and sync them to disk; false if they couldn't be spooled
+bool spoolAppend(spool_t *sp, DBRecord *rows, int n) {
+    uint64_t tail;
+    if (sp == NULL) return false;
+    tail = sp->hdr->tail;
+    if (spoolSize(tail + n) > sp->mapsize)
+        if (!spoolResize(sp, tail + n + SPOOL_GROW)) return false;
+    for (int i = 0; i < n; i++) {
+        DBRecord *r = SPOOL_REC(sp, tail + i);
+        *r = rows[i];
+        r->node = NULL;           // not meaningful after a restart
+    };
+    // msync() needs a page-aligned start address
+    size_t start = spoolSize(tail) & ~(size_t)(SPOOL_HDR-1);
+    msync(sp->map + start, spoolSize(tail + n) - start, MS_SYNC);
+    sp->hdr->tail = tail + n;
+    spoolSyncHdr(sp);
+    return true;
+};
+
+// Point '*rows' at up to 'max' of the oldest pending records; returns the count
+// The pointer is valid only until the next spoolAppend()
+int spoolPeek(spool_t *sp, DBRecord **rows, int max) {
+    long n = spoolCount(sp);
+    if (n == 0) return 0;
+    *rows = SPOOL_REC(sp, sp->hdr->head);
+    return (n < max) ? n : max;
+};
+
+// The oldest 'n' records have been committed: drop them from the spool
+void spoolConsume(spool_t *sp, int n) {
+    uint64_t head, count;
+    sp->hdr->head += n;
+    if (sp->hdr->head >= sp->hdr->tail) {
+        sp->hdr->head = sp->hdr->tail = 0;
+        spoolSyncHdr(sp);
+        spoolResize(sp, SPOOL_GROW);
+        return;
+    };
+    spoolSyncHdr(sp);
+
+    // Once 'head' is past half the file, the pending records fit below it:
+    //   move them to the start, and only then the header, so the spool
+    //   doesn't keep growing while it's drained under a steady load
+    head  = sp->hdr->head;
+    count = sp->hdr->tail - head;
+    if (spoolSize(2*head) <= sp->mapsize) return;
+    memcpy(SPOOL_REC(sp, 0), SPOOL_REC(sp, head), count*sizeof(DBRecord));
+    msync(sp->map, spoolSize(count), MS_SYNC);
+    sp->hdr->head = 0;
+    sp->hdr->tail = count;
+    spoolSyncHdr(sp);
+    spoolResize(sp, count + SPOOL_GROW);
+    LOG(LM_SPOOL, LV_DEBUG, "Compacted spool file '%s' to %lu records\n",
+        sp->path, (unsigned long)count);
+};
@@ -0,0 +1,297 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_sqlite.c
+    sqlite3 storage backend for WDL_433, weather data logger for rtl_433
+    Selected with 'backend = sqlite3' (the default).
+
+    The database is kept open, with the INSERT command prepared once,
+    from the first batch until a batch fails; it is then closed and
+    reopened for the next batch, so a database file that is replaced
+    or has its permissions fixed is picked up.
+
+    For a bulk import (WDL_433 --import), the table's indexes are
+    dropped at the start and rebuilt at the end, which is much faster
+    than updating them row by row, and the database is written with
+    synchronous=OFF and an in-memory journal: a crash during the import
+    can leave the database damaged, so back it up first.
+
+    Written by HDTodd, hdtodd@gmail.com, 2016, for use with WeatherStation.c
+    Revised 2025.04.15 for use with WDL_433, weather data logger for rtl_433
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sqlite3.h>
+
+#include "WDL_433.h"
+
+#define SQL3_BUSY 2000        // msec to wait for a busy sqlite3 database
+#define sqlStringLen 300
+
+extern bool DEBUG;
+extern bool bulkLoad;
+extern aggregate_t aggregate;
+extern char *sql3path;
+extern char *sql3file;
+static char sql3fullpath[FNLEN+1];
+static sqlite3      *db     = NULL;   // database handle, while prepared
+static sqlite3_stmt *insert = NULL;   // prepared INSERT command
+static char        **indexes = NULL;  // CREATE INDEX commands, for after a bulk import
+static int           nindexes = 0;
+
+static int callback(void *NotUsed, int argc, char **argv,
+        char **azColName); // not used at present but ref'd by sqlite3 call
+
+// Values are recorded to the precision they always were
+static double round1(double x) {
+    return round(x*10)/10;
+};
+
+// Drop the table's indexes for a bulk import, keeping the commands that create them
+static void sql3DropIndexes(void) {
+    sqlite3_stmt *stmt;
+    char **names = NULL, sql[sqlStringLen];
+    if (sqlite3_prepare_v2(db, "SELECT name, sql FROM sqlite_master WHERE type = 'index'"
+                           " AND tbl_name = '" DBTABLE "' AND sql IS NOT NULL",
+                           -1, &stmt, NULL) != SQLITE_OK) return;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        names   = realloc(names, (nindexes+1)*sizeof(char *));
+        indexes = realloc(indexes, (nindexes+1)*sizeof(char *));
+        names[nindexes]     = strdup((char *)sqlite3_column_text(stmt, 0));
+        indexes[nindexes++] = strdup((char *)sqlite3_column_text(stmt, 1));
+    };
+    sqlite3_finalize(stmt);
+    for (int i = 0; i < nindexes; i++) {
+        snprintf(sql, sizeof(sql), "DROP INDEX IF EXISTS \"%s\"", names[i]);
+        if (sqlite3_exec(db, sql, NULL, 0, NULL) != SQLITE_OK) {
+            fprintf(stderr, "?Can't drop index '%s' for import: %s\n", names[i], sqlite3_errmsg(db));
+            exit(EXIT_FAILURE);
+        };
+        LOG(LM_DB, LV_INFO, "Index '%s' dropped for the import\n", names[i]);
+        free(names[i]);
+    };
+    free(names);
+};
+
+// Add the columns for the windows' minima and maxima, if they aren't there
+static void sql3AddColumns(void) {
+    char sql[sqlStringLen];
+    for (int f = 0; f < 2*AGG_FIELDS; f++) {
+        snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s_%s REAL",
+                 DBTABLE, aggFields[f/2], (f%2 == 0) ? "min" : "max");
+        if ( (sqlite3_exec(db, sql, NULL, 0, NULL) == SQLITE_OK) && DEBUG )
+            printf("Added column %s_%s to sqlite3 table '%s'\n",
+                   aggFields[f/2], (f%2 == 0) ? "min" : "max", DBTABLE);
+    };
+};
+
+// Check that the database and table exist, creating them if necessary
+// Returns false if the database is locked now
+static bool sql3Init(sink_t *sk) {
+    char sqlString[sqlStringLen];
+    char *zErrMsg = 0;
+    int  rc;
+
+    //create sqlite3 db if necessary
+    snprintf(sql3fullpath, FNLEN, "%s/%s", sql3path, sql3file);
+    if (DEBUG) printf("Initializing sqlite3 database at '%s' if necessary\n",
+                      sql3fullpath);
+    rc = sqlite3_open(sql3fullpath, &db);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "?Can't open or create sqlite3database %s\n%s\n",
+                sql3fullpath, sqlite3_errmsg(db));
+        exit(EXIT_FAILURE);
+    } else {
+        if (DEBUG) printf("Opened sqlite3 database %s\n", sql3fullpath);
+    };
+
+    // If the table doesn't exist, create it
+    strcpy(sqlString, "CREATE TABLE if not exists "); strcat(sqlString, DBTABLE);
+    strcat(sqlString, " (date_time TEXT, sensorID TEXT,");
+    strcat(sqlString, "temp1 REAL, temp2 REAL, rh REAL, ");
+    strcat(sqlString, "press REAL, light REAL)");
+    if (DEBUG) printf("Creating sqlite3 database table with command\n   %s\n", sqlString);
+    sqlite3_busy_timeout(db, SQL3_BUSY);
+    rc = sqlite3_exec(db, sqlString, callback, 0, &zErrMsg);
+    if (rc == SQLITE_BUSY) {
+        // Locked by another process: records are spooled until it's released
+        LOG(LM_DB, LV_WARN, "sqlite3 database '%s' is locked: spooling records\n", sql3fullpath);
+        sqlite3_free(zErrMsg);
+        sqlite3_close(db);
+        db = NULL;
+        return false;
+    };
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "?Can't open or create sqlite3 database table '%s'\n", DBTABLE);
+        fprintf(stderr, "\tsqlite3 error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        exit(EXIT_FAILURE);
+    }
+    else {
+        if (DEBUG) printf("sqlite3 table '%s' opened or created successfully\n", DBTABLE);
+    };
+    // Charts read each sensor's rows in time order
+    if (sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS " DBTABLE "_sensor_time ON " DBTABLE
+                     " (sensorID, date_time)", NULL, 0, NULL) != SQLITE_OK)
+        LOG(LM_DB, LV_WARN, "Can't create index on sqlite3 table '%s': %s\n",
+            DBTABLE, sqlite3_errmsg(db));
+    if (bulkLoad) sql3DropIndexes();
+    sqlite3_close(db);
+    db = NULL;
+    return true;
+};
+
+static void sql3Close(void) {
+    sqlite3_finalize(insert);        // harmless if NULL
+    sqlite3_close(db);               // an open transaction is rolled back
+    insert = NULL;
+    db     = NULL;
+};
+
+// Open the database and prepare the INSERT command
+static bool sql3Prepare(void) {
+    int rc;
+    if (insert != NULL) return true;
+    rc = sqlite3_open(sql3fullpath, &db);
+    if (rc != SQLITE_OK) {
+        LOG(LM_DB, LV_ERR, "Can't open sqlite3 database file '%s': %s\n",
+            sql3fullpath, sqlite3_errmsg(db));
+        sql3Close();
+        return false;
+    };
+    sqlite3_busy_timeout(db, SQL3_BUSY);
+    if (bulkLoad)
+        sqlite3_exec(db, "PRAGMA synchronous = OFF; PRAGMA journal_mode = MEMORY;"
+                     " PRAGMA cache_size = -65536", NULL, 0, NULL);
+    if (aggregate == AGG_MINMAX) sql3AddColumns();
+    rc = sqlite3_prepare_v2(db, (aggregate == AGG_MINMAX)
+                            ? "INSERT INTO " DBTABLE
+                              " (date_time, sensorID, temp1, temp2, rh, press, light,"
+                              " temp1_min, temp1_max, temp2_min, temp2_max, rh_min, rh_max,"
+                              " press_min, press_max, light_min, light_max)"
+                              " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+                            : "INSERT INTO " DBTABLE
+                              " (date_time, sensorID, temp1, temp2, rh, press, light)"
+                              " VALUES (?, ?, ?, ?, ?, ?, ?)", -1, &insert, NULL);
+    if (rc != SQLITE_OK) {
+        LOG(LM_DB, LV_ERR, "sqlite3 can't prepare INSERT for '%s': %s\n",
+            sql3fullpath, sqlite3_errmsg(db));
+        sql3Close();
+        return false;
+    };
+    return true;
+};
+
+// Append 'n' records in one transaction; 'done' is called before returning
+static void sql3Append(DBRecord *rows, int n, dbdone_cb done, void *arg) {
+    int rc;
+
+    rc = (n > 1) ? sqlite3_exec(db, "BEGIN", NULL, 0, NULL) : SQLITE_OK;
+    for (int i = 0; (i < n) && (rc == SQLITE_OK); i++) {
+        DBRecord *DBRow = &rows[i];
+        if (LOGGING(LM_DB, LV_DEBUG))
+            LOG(LM_DB, LV_DEBUG, "sqlite3 insert: '%s', '%s', %5.1f, %5.1f, %3.0f, %6.1f, %3.0f\n",
+                DBRow->date_time, DBRow->sensorID, DBRow->temp1, DBRow->temp2,
+                DBRow->rh, DBRow->press, DBRow->light);
+        sqlite3_bind_text(insert, 1, DBRow->date_time, -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert, 2, DBRow->sensorID, -1, SQLITE_STATIC);
+        sqlite3_bind_double(insert, 3, round1(DBRow->temp1));
+        sqlite3_bind_double(insert, 4, round1(DBRow->temp2));
+        sqlite3_bind_double(insert, 5, round(DBRow->rh));
+        sqlite3_bind_double(insert, 6, round1(DBRow->press));
+        sqlite3_bind_double(insert, 7, round(DBRow->light));
+        if (aggregate == AGG_MINMAX)
+            for (int f = 0; f < AGG_FIELDS; f++) {
+                sqlite3_bind_double(insert, 8+2*f,
+                                    (aggDigits[f] == 0) ? round(DBRow->min[f]) : round1(DBRow->min[f]));
+                sqlite3_bind_double(insert, 9+2*f,
+                                    (aggDigits[f] == 0) ? round(DBRow->max[f]) : round1(DBRow->max[f]));
+            };
+        rc = sqlite3_step(insert);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        sqlite3_reset(insert);
+    };
+    if ( (n > 1) && (rc == SQLITE_OK) )
+        rc = sqlite3_exec(db, "COMMIT", NULL, 0, NULL);
+    if (rc != SQLITE_OK) {
+        LOG(LM_DB, LV_ERR, "sqlite3 error during row insert: %s\n", sqlite3_errmsg(db));
+        LOG(LM_DB, LV_ERR, "Can't write to database file %s: check permissions\n", sql3fullpath);
+        sql3Close();
+        done(arg, DB_DOWN);
+        return;
+    };
+    done(arg, DB_OK);
+};
+
+// Release the database when WDL_433 stops, rebuilding any indexes
+//   dropped for a bulk import
+static void sql3End(void) {
+    sql3Close();
+    if (nindexes == 0) return;
+    if (sqlite3_open(sql3fullpath, &db) != SQLITE_OK) {
+        LOG(LM_DB, LV_ERR, "Can't reopen '%s' to rebuild its indexes\n", sql3fullpath);
+        return;
+    };
+    sqlite3_busy_timeout(db, SQL3_BUSY);
+    for (int i = 0; i < nindexes; i++) {
+        LOG(LM_DB, LV_INFO, "Rebuilding index: %s\n", indexes[i]);
+        if (sqlite3_exec(db, indexes[i], NULL, 0, NULL) != SQLITE_OK)
+            LOG(LM_DB, LV_ERR, "Can't rebuild index: %s\n", sqlite3_errmsg(db));
+        free(indexes[i]);
+    };
+    nindexes = 0;
+    sqlite3_close(db);
+    db = NULL;
+};
+
+// Nothing is held back: each batch is committed before sql3Append() returns
+static void sql3Flush(void) {
+};
+
+// Pass the sensorID and time of the latest row for each sensor to 'cb'
+static void sql3LastTimes(void (*cb)(char *sensorID, char *date_time)) {
+    sqlite3      *rdb;
+    sqlite3_stmt *stmt;
+    int rc;
+
+    rc = sqlite3_open(sql3fullpath, &rdb);
+    if (rc != SQLITE_OK) {
+        LOG(LM_DB, LV_WARN, "Can't open sqlite3 database file '%s'\n", sql3fullpath);
+        sqlite3_close(rdb);
+        return;
+    };
+    rc = sqlite3_prepare_v2(rdb, "SELECT sensorID, MAX(date_time) FROM " DBTABLE
+                            " GROUP BY sensorID", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        LOG(LM_DB, LV_WARN, "sqlite3 error reading latest rows: %s\n", sqlite3_errmsg(rdb));
+        sqlite3_close(rdb);
+        return;
+    };
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        char *sensorID  = (char *) sqlite3_column_text(stmt, 0);
+        char *date_time = (char *) sqlite3_column_text(stmt, 1);
+        if ( (sensorID != NULL) && (date_time != NULL) ) cb(sensorID, date_time);
+    };
+    sqlite3_finalize(stmt);
+    sqlite3_close(rdb);
+};
+
+static int callback(void *NotUsed, int argc, char **argv, char **azColName) {
+    for (int i = 0; i < argc; i++) {
+        printf("%s = %s\n", azColName[i], argv[i] ? argv[i] : "NULL");
+    }
+    printf("\n");
+    return (0);
+}; // end int callback()
+
+backend_t sqliteBackend = {
+    .name        = "sqlite3",
+    .init        = sql3Init,
+    .prepare     = sql3Prepare,
+    .appendBatch = sql3Append,
+    .flush       = sql3Flush,
+    .close       = sql3End,
+    .lastTimes   = sql3LastTimes,
+};
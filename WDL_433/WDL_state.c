@@ -0,0 +1,238 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_state.c
+    Save and restore the sensor registry of WDL_433 across restarts
+
+    Without saved state, every sensor's 'lasttime' is 0 when WDL_433
+    starts, so every sensor is recorded immediately after a restart
+    regardless of 'recordingInterval'.  To avoid that burst of inserts,
+    the registry (every sensorID seen and the time it was last
+    recorded) and the de-duplication state are written to a compact
+    binary state file when WDL_433 exits and every STATE_INTERVAL
+    seconds while it runs.  On startup the file is mapped into memory
+    and the registry is rebuilt from it.  If there is no usable state
+    file, the time of the latest database row for each sensor is used
+    instead.
+
+    The state file is
+        stateHdr                 header
+        stateRec[count]          one record per sensor
+        char strings[strbytes]   NUL-terminated sensorIDs
+    in the byte order of the host that wrote it.  It is written to a
+    temporary file which is then renamed, so a crash never leaves a
+    partial state file behind.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "WDL_433.h"
+
+extern NPTR   sensors;
+extern char  *stateFile;
+extern char   lastSensorID[];
+extern time_t lasttime;
+
+#define STATE_MAGIC   "WDL433S"
+#define STATE_VERSION 1
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;           // number of stateRec's
+    uint32_t strbytes;        // size of string table
+    uint32_t lastoff;         // offset in string table of 'lastSensorID'
+    int64_t  lasttime;        // de-duplication time of 'lastSensorID'
+    int64_t  saved;           // time the file was written
+} stateHdr;
+
+typedef struct {
+    int64_t  lasttime;
+    uint32_t keyoff;          // offset of sensorID in string table
+    uint32_t spare;
+} stateRec;
+
+// Table being built for a snapshot
+static struct {
+    stateRec *recs;
+    char     *strs;
+    uint32_t  count, maxrecs;
+    uint32_t  strbytes, maxstr;
+} snap;
+
+static uint32_t snapString(char *s) {
+    uint32_t off = snap.strbytes;
+    size_t   len = strlen(s) + 1;
+    while (snap.strbytes + len > snap.maxstr) {
+        snap.maxstr = (snap.maxstr == 0) ? 4096 : 2*snap.maxstr;
+        if ( (snap.strs = realloc(snap.strs, snap.maxstr)) == NULL ) {
+            fprintf(stderr, "Out of memory saving WDL_433 state\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    memcpy(snap.strs + off, s, len);
+    snap.strbytes += len;
+    return off;
+};
+
+static void snapTree(NPTR p) {
+    if (p == NULL) return;
+    snapTree(p->lptr);
+    if (snap.count == snap.maxrecs) {
+        snap.maxrecs = (snap.maxrecs == 0) ? 64 : 2*snap.maxrecs;
+        if ( (snap.recs = realloc(snap.recs, snap.maxrecs*sizeof(stateRec))) == NULL ) {
+            fprintf(stderr, "Out of memory saving WDL_433 state\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    snap.recs[snap.count].lasttime = p->lasttime;
+    snap.recs[snap.count].keyoff   = snapString(p->key);
+    snap.recs[snap.count].spare    = 0;
+    snap.count++;
+    snapTree(p->rptr);
+};
+
+// Write the sensor registry to the state file
+void stateSave(void) {
+    char     tmpFile[PATH_MAX];
+    stateHdr hdr;
+    FILE    *f;
+
+    if ( (stateFile == NULL) || (*stateFile == '\0') ) return;
+    snap.count = snap.strbytes = 0;
+    snapTree(sensors);
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, STATE_MAGIC);
+    hdr.version  = STATE_VERSION;
+    hdr.count    = snap.count;
+    hdr.lastoff  = snapString(lastSensorID);
+    hdr.lasttime = lasttime;
+    hdr.strbytes = snap.strbytes;
+    hdr.saved    = time(NULL);
+
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", stateFile);
+    if ( (f = fopen(tmpFile, "w")) == NULL ) {
+        LOG(LM_STATE, LV_WARN, "Can't write state file '%s'\n", tmpFile);
+        return;
+    };
+    if ( (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+         || (fwrite(snap.recs, sizeof(stateRec), snap.count, f) != snap.count)
+         || (fwrite(snap.strs, 1, snap.strbytes, f) != snap.strbytes)
+         || (fflush(f) != 0) || (fsync(fileno(f)) != 0) ) {
+        LOG(LM_STATE, LV_WARN, "Error writing state file '%s'\n", tmpFile);
+        fclose(f);
+        unlink(tmpFile);
+        return;
+    };
+    fclose(f);
+    if (rename(tmpFile, stateFile) != 0) {
+        LOG(LM_STATE, LV_WARN, "Can't rename '%s' to '%s'\n", tmpFile, stateFile);
+        unlink(tmpFile);
+        return;
+    };
+    LOG(LM_STATE, LV_DEBUG, "Saved state of %u sensors to '%s'\n", snap.count, stateFile);
+};
+
+// Timer procedure for periodic saves
+void stateTimer(void *arg) {
+    stateSave();
+};
+
+// Note that 'key' was last recorded at time 'when'
+static void stateSet(char *key, time_t when) {
+    NPTR node = node_find(sensors, key, true);
+    if (sensors == NULL) sensors = node;
+    if ( (node != NULL) && (when > node->lasttime) ) node->lasttime = when;
+};
+
+// Restore the registry from the state file; returns false if there
+//   is no usable state file
+static bool stateLoadFile(void) {
+    struct stat st;
+    stateHdr   *hdr;
+    stateRec   *recs;
+    char       *strs, *map;
+    int         fd;
+    bool        ok = false;
+
+    if ( (fd = open(stateFile, O_RDONLY)) < 0 ) return false;
+    if ( (fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(stateHdr)) ) {
+        close(fd);
+        return false;
+    };
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    hdr  = (stateHdr *) map;
+    recs = (stateRec *) (map + sizeof(stateHdr));
+    strs = (char *) (recs + hdr->count);
+    if ( (memcmp(hdr->magic, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0)
+         || (hdr->version != STATE_VERSION)
+         || (st.st_size != (off_t)(sizeof(stateHdr) + hdr->count*sizeof(stateRec)
+                                   + hdr->strbytes))
+         || (hdr->strbytes == 0) || (strs[hdr->strbytes-1] != '\0')
+         || (hdr->lastoff >= hdr->strbytes) ) {
+        LOG(LM_STATE, LV_WARN, "State file '%s' is not valid: ignored\n", stateFile);
+        goto done;
+    };
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        if (recs[i].keyoff >= hdr->strbytes) continue;
+        stateSet(strs + recs[i].keyoff, (time_t) recs[i].lasttime);
+    };
+    strncpy(lastSensorID, strs + hdr->lastoff, 200);
+    lasttime = (time_t) hdr->lasttime;
+    LOG(LM_STATE, LV_INFO, "Restored state of %u sensors saved %ld sec ago\n",
+        hdr->count, (long)(time(NULL) - hdr->saved));
+    ok = true;
+done:
+    munmap(map, st.st_size);
+    return ok;
+};
+
+// Find a node by the name it is recorded under (its alias, if it has one)
+static void stateSetRecorded(NPTR p, char *sensorID, time_t when, bool *found) {
+    if (p == NULL) return;
+    stateSetRecorded(p->lptr, sensorID, when, found);
+    if ( (p->alias != NULL) && (strcmp(p->alias, sensorID) == 0) ) {
+        if (when > p->lasttime) p->lasttime = when;
+        *found = true;
+    };
+    stateSetRecorded(p->rptr, sensorID, when, found);
+};
+
+// Callback from dbLastTimes() with the latest row for a sensorID
+static void stateFromDB(char *sensorID, char *date_time) {
+    struct tm tm;
+    bool found = false;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(date_time, "%Y-%m-%d %H:%M:%S", &tm) == NULL) return;
+    tm.tm_isdst = -1;
+    time_t when = mktime(&tm);
+    stateSetRecorded(sensors, sensorID, when, &found);
+    // A sensor aliased by a pattern has no node until it's seen, and a
+    //   node made for the alias would never be matched: skip its row
+    if ( !found && aliasByPattern(sensorID) ) {
+        LOG(LM_STATE, LV_DEBUG, "'%s' is aliased by a pattern: its last time isn't restored\n", sensorID);
+        return;
+    };
+    if (!found) stateSet(sensorID, when);
+};
+
+// Restore the sensor registry at startup
+void stateLoad(void) {
+    if ( (stateFile != NULL) && (*stateFile != '\0') && stateLoadFile() ) return;
+    LOG(LM_STATE, LV_INFO, "No saved state: using latest database rows for sensor times\n");
+    dbLastTimes(stateFromDB);
+};
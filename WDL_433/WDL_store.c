@@ -0,0 +1,528 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_store.c
+    Storage stage for WDL_433, weather data logger for rtl_433
+
+    Records accepted by processMessage() are passed to storeRecord(),
+    which hands a copy to each sink: one for each backend named in
+    'backend', e.g. 'backend = sqlite3, mysql:retry=30:batch=1000'.
+    Each sink has its own queue, its own writer thread running its
+    own event loop, its own spool, and its own retry interval ('retry',
+    default SPOOL_RETRY sec) and batch size ('batch', default SPOOL_BATCH
+    records), so a slow or unavailable backend delays only its own sink.
+
+    Within a sink, one batch at a time is sent to the backend; while it
+    is in progress (a MySQL INSERT waits for the server's reply), later
+    records collect in the next batch, which is sent as soon as the
+    first completes.
+
+    If the backend can't take a batch (MySQL server down, sqlite3
+    database busy or read-only), it goes to the sink's on-disk spool
+    instead, and so does every later record until the spool has been
+    emptied, so records reach the backend in the order they were
+    received.  So do records for a backend that's up but more than
+    SINK_QUEUE records behind, rather than queueing without limit, once
+    the batch in flight is done: if it fails, it's spooled ahead of
+    them.  A timer retries the backend every 'retry' sec (or sooner, if
+    the MySQL connection is re-established) and, once it accepts records
+    again, replays the spool in batches.  The first sink uses
+    'spoolfile'; the others add their backend's name to it.
+
+    The first sink listed is the primary one: the records it commits
+    are passed back to the main thread, which updates their freshness.
+
+    For a bulk import (WDL_import.c), sinks have no spool, take batches
+    of up to IMPORT_BATCH records, and don't report freshness.
+
+    If there is no spool, or the spool can't be written, a record the
+    backend can't take is a fatal error, as it always was.  A batch the
+    backend rejects outright (an SQL error, not a lost connection) would
+    be rejected again however often it was retried, so it's logged and
+    dropped, and the records after it go on to the backend.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/eventfd.h>
+
+#include "WDL_433.h"
+
+extern char *backend;
+extern char *spoolFile;
+extern bool  bulkLoad;
+
+#define MAX_SINKS  4              // one for each backend
+#define SINK_QUEUE 10000          // spool once this many records wait for a sink
+
+typedef struct {
+    DBRecord *rows;
+    int       count, max;
+} batch_t;
+
+struct sink {
+    backend_t *be;
+    evloop_t  *ev;
+    pthread_t  thread;
+    bool       primary;           // report commits to the main thread
+    int        retry;             // sec between attempts while unavailable
+    int        batchMax;          // most records in one batch
+
+    // Records handed over by the main thread
+    pthread_mutex_t lock;
+    int        efd;               // eventfd: records handed over, or stop
+    batch_t    handoff;
+    bool       stopping;
+
+    // Used only by the sink's thread once it has started
+    batch_t    taken;             // records taken from 'handoff'
+    spool_t   *spool;
+    bool       dbUp;              // backend accepted the last records
+    bool       prepared;          // be->prepare() succeeded and nothing failed since
+    bool       replaying;         // 'inflight' was read from the spool
+    int        replayTimer;
+    batch_t    batch[2];
+    batch_t   *pending;           // collecting records
+    batch_t   *inflight;          // on its way to the backend
+    long       backlog;           // records in 'pending' and 'inflight'
+    unsigned long committed;      // records the backend has committed
+};
+
+static sink_t *sinks[MAX_SINKS];
+static int     nsinks = 0;
+
+// Records committed by the primary sink, waiting for the main thread
+static pthread_mutex_t commitLock = PTHREAD_MUTEX_INITIALIZER;
+static batch_t commits, committed;
+static unsigned long recorded = 0;  // committed by the first sink, once stopped
+static int     commitFd = -1;
+
+static void storeReplay(void *arg);
+static void storeSend(sink_t *sk);
+
+static void batchRoom(batch_t *b, int n) {
+    if (b->count + n <= b->max) return;
+    b->max = (b->max == 0) ? 64 : 2*b->max;
+    if (b->max < b->count + n) b->max = b->count + n;
+    if ( (b->rows = realloc(b->rows, b->max*sizeof(DBRecord))) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory queueing database records\n");
+        exit(EXIT_FAILURE);
+    };
+};
+
+static void batchAdd(batch_t *b, DBRecord *rows, int n) {
+    batchRoom(b, n);
+    memcpy(b->rows + b->count, rows, n*sizeof(DBRecord));
+    b->count += n;
+};
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {};
+};
+
+evloop_t *sinkLoop(sink_t *sk) {
+    return sk->ev;
+};
+
+// Start the replay timer if it isn't already running
+static void storeRetry(sink_t *sk, long ms) {
+    if (sk->replayTimer == 0)
+        sk->replayTimer = evTimer(sk->ev, ms, false, storeReplay, sk);
+};
+
+// Spool records the backend couldn't take, or give up if they can't be spooled
+static void storeSpool(sink_t *sk, DBRecord *rows, int n) {
+    if ( (n > 0) && !spoolAppend(sk->spool, rows, n) ) {
+        fprintf(stderr, "?WDL_433: can't record or spool data for sensor %s to %s\n",
+                rows[0].sensorID, sk->be->name);
+        exit(EXIT_FAILURE);
+    };
+};
+
+// Let the main thread see how many records the sink is holding
+static void sinkBacklog(sink_t *sk) {
+    __atomic_store_n(&sk->backlog, sk->pending->count + sk->inflight->count, __ATOMIC_RELAXED);
+};
+
+// The backend has committed the batch in flight, or rejected it, or failed to
+static void storeDone(void *arg, dbresult_t result) {
+    sink_t *sk = arg;
+    int n = sk->inflight->count;
+    if (result == DB_REJECTED) {
+        // Retrying a batch the backend won't take would stop every later
+        //   record behind it: log it and go on as if it had been committed
+        LOG(LM_DB, LV_ERR, "%s: backend rejected %d records: they are dropped\n",
+            sk->be->name, n);
+        for (int i = 0; i < n; i++)
+            LOG(LM_DB, LV_ERR, "%s: dropped record %s %s\n", sk->be->name,
+                sk->inflight->rows[i].date_time, sk->inflight->rows[i].sensorID);
+    } else if (result == DB_OK) {
+        __atomic_add_fetch(&sk->committed, n, __ATOMIC_RELAXED);
+        if (sk->primary) {
+            pthread_mutex_lock(&commitLock);
+            batchAdd(&commits, sk->inflight->rows, n);
+            pthread_mutex_unlock(&commitLock);
+            wake(commitFd);
+        };
+    };
+    if (result != DB_DOWN) {
+        sk->inflight->count = 0;
+        sk->dbUp = true;
+        if (sk->replaying) {
+            spoolConsume(sk->spool, n);
+            LOG(LM_SPOOL, LV_DEBUG, "%s: replayed %d spooled records, %ld remain\n",
+                sk->be->name, n, spoolCount(sk->spool));
+            if (spoolCount(sk->spool) == 0)
+                LOG(LM_SPOOL, LV_INFO, "%s: spool emptied: database is up to date\n",
+                    sk->be->name);
+        };
+        sk->replaying = false;
+        if ( (sk->spool != NULL) && (sk->pending->count > SINK_QUEUE) ) {
+            // Behind: the records held go to the spool, ahead of later ones
+            storeSpool(sk, sk->pending->rows, sk->pending->count);
+            sk->pending->count = 0;
+        };
+        if (sk->pending->count > 0)
+            storeSend(sk);
+        else if (spoolCount(sk->spool) > 0)
+            storeRetry(sk, 1);
+        sinkBacklog(sk);
+        return;
+    };
+
+    // Keep the order of the records: the failed batch, then those collected since
+    sk->inflight->count = 0;
+    sk->prepared = false;
+    if (!sk->replaying) storeSpool(sk, sk->inflight->rows, n);
+    storeSpool(sk, sk->pending->rows, sk->pending->count);
+    sk->pending->count = 0;
+    if (sk->dbUp)
+        LOG(LM_SPOOL, LV_WARN, "%s: database unavailable: spooling records until it recovers\n",
+            sk->be->name);
+    else if (sk->replaying)
+        LOG(LM_SPOOL, LV_DEBUG, "%s: database still unavailable: %ld records spooled\n",
+            sk->be->name, spoolCount(sk->spool));
+    sk->dbUp = false;
+    sk->replaying = false;
+    storeRetry(sk, sk->retry*1000L);
+    sinkBacklog(sk);
+};
+
+// Send 'inflight' to the backend, preparing it first if need be
+static void storeAppend(sink_t *sk) {
+    if (!sk->prepared)
+        sk->prepared = (sk->be->prepare == NULL) || sk->be->prepare();
+    if (!sk->prepared) {
+        storeDone(sk, DB_DOWN);
+        return;
+    };
+    sk->be->appendBatch(sk->inflight->rows, sk->inflight->count, storeDone, sk);
+};
+
+// Send the records collected so far (up to a batch), unless a batch is already in flight
+static void storeSend(sink_t *sk) {
+    batch_t *b;
+    int n = sk->pending->count;
+    if ( (sk->inflight->count > 0) || (n == 0) ) return;
+    if (n <= sk->batchMax) {
+        b = sk->inflight;
+        sk->inflight = sk->pending;
+        sk->pending  = b;
+    } else {
+        n = sk->batchMax;
+        batchAdd(sk->inflight, sk->pending->rows, n);
+        sk->pending->count -= n;
+        memmove(sk->pending->rows, sk->pending->rows + n, sk->pending->count*sizeof(DBRecord));
+    };
+    sk->replaying = false;
+    storeAppend(sk);
+};
+
+// Replay one batch from the spool; storeDone() continues with the next
+static void storeReplay(void *arg) {
+    sink_t   *sk = arg;
+    DBRecord *rows;
+    int n;
+
+    sk->replayTimer = 0;
+    if (sk->inflight->count > 0) return;       // storeDone() will call again
+    n = spoolPeek(sk->spool, &rows, sk->batchMax);
+    if (n == 0) {
+        sk->dbUp = true;
+        return;
+    };
+    // Copy the batch: the spool may move when records are added to it
+    batchAdd(sk->inflight, rows, n);
+    sk->replaying = true;
+    storeAppend(sk);
+};
+
+// The backend has become available again: replay the spool now
+void storeWake(sink_t *sk) {
+    if ( sk->dbUp && (spoolCount(sk->spool) == 0) ) return;
+    if (sk->replayTimer != 0) evCancel(sk->ev, sk->replayTimer);
+    sk->replayTimer = 0;
+    storeRetry(sk, 1);
+};
+
+// Queue records for the backend, or append them to the spool if the
+//   backend can't take them, or is more than SINK_QUEUE records behind,
+//   or there are older records waiting in the spool
+static void sinkRecords(sink_t *sk, DBRecord *rows, int n) {
+    long held = sk->pending->count + sk->inflight->count;
+    if (n == 0) return;
+    if ( sk->dbUp && (spoolCount(sk->spool) == 0) ) {
+        if ( (sk->spool == NULL) || (held + n <= SINK_QUEUE) ) {
+            batchAdd(sk->pending, rows, n);
+            return;
+        };
+        if (held <= SINK_QUEUE)
+            LOG(LM_SPOOL, LV_WARN, "%s: database is falling behind: spooling records "
+                "until it catches up\n", sk->be->name);
+    };
+    // The spool takes records only after those held here; while a batch
+    //   not from the spool is in flight (it may yet fail, and be spooled),
+    //   they're held too, and spooled by storeDone()
+    if ( (sk->inflight->count > 0) && !sk->replaying ) {
+        batchAdd(sk->pending, rows, n);
+        return;
+    };
+    storeSpool(sk, sk->pending->rows, sk->pending->count);
+    sk->pending->count = 0;
+    storeSpool(sk, rows, n);
+    if (sk->inflight->count == 0) storeRetry(sk, 1);
+};
+
+// The main thread has handed over records, or asked the sink to stop
+static void sinkEvent(int fd, uint32_t events, void *arg) {
+    sink_t  *sk = arg;
+    uint64_t n;
+    batch_t  b;
+    bool     stop;
+
+    if (read(fd, &n, sizeof(n)) < 0) {};
+    pthread_mutex_lock(&sk->lock);
+    b = sk->taken;
+    sk->taken   = sk->handoff;
+    sk->handoff = b;
+    stop = sk->stopping;
+    pthread_mutex_unlock(&sk->lock);
+    sinkRecords(sk, sk->taken.rows, sk->taken.count);
+    sk->taken.count = 0;
+    storeSend(sk);
+    sinkBacklog(sk);
+    if (stop) evStop(sk->ev);
+};
+
+// Writer thread: run the sink's loop, then finish sending what has been
+//   collected, and replaying what was spooled while the backend was
+//   behind, spooling anything the backend won't take
+static void *sinkThread(void *arg) {
+    sink_t *sk = arg;
+    evRun(sk->ev);
+    for (;;) {
+        if (sk->inflight->count == 0) {
+            if (!sk->dbUp && (sk->pending->count > 0)) {
+                storeSpool(sk, sk->pending->rows, sk->pending->count);
+                sk->pending->count = 0;
+            };
+            if (sk->pending->count > 0)
+                storeSend(sk);
+            else if (sk->dbUp && (spoolCount(sk->spool) > 0))
+                storeReplay(sk);
+            else
+                break;
+        };
+        if (sk->be->flush != NULL) sk->be->flush();
+    };
+    spoolClose(sk->spool);
+    sk->spool = NULL;
+    if (sk->be->close != NULL) sk->be->close();
+    return NULL;
+};
+
+// Records committed by the primary sink: update their freshness and
+//   the chart views and latest readings, and send them to the chart-data
+//   streams
+static void commitEvent(int fd, uint32_t events, void *arg) {
+    uint64_t n;
+    batch_t  b;
+    if (read(fd, &n, sizeof(n)) < 0) {};
+    pthread_mutex_lock(&commitLock);
+    b = committed;
+    committed = commits;
+    commits   = b;
+    pthread_mutex_unlock(&commitLock);
+    for (int i = 0; i < committed.count; i++) {
+        freshRecord(&committed.rows[i]);
+        viewRecord(&committed.rows[i]);
+        httpRecord(&committed.rows[i]);
+        latestRecord(&committed.rows[i]);
+    };
+    committed.count = 0;
+    viewFlush();
+};
+
+// Set up a sink for the backend described by 'desc' ("name[:retry=sec][:batch=n]")
+static void sinkNew(char *desc) {
+    char   *opt, *save, path[PATH_MAX];
+    sink_t *sk;
+
+    if ( (opt = strtok_r(desc, ":", &save)) == NULL ) return;
+    if (nsinks == MAX_SINKS) {
+        fprintf(stderr, "?WDL_433: too many backends in '%s'\n", backend);
+        exit(EXIT_FAILURE);
+    };
+    if ( (sk = calloc(1, sizeof(sink_t))) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for backend '%s'\n", opt);
+        exit(EXIT_FAILURE);
+    };
+    if ( (sk->be = backendFind(opt)) == NULL ) {
+        fprintf(stderr, "?Unknown storage backend '%s': use [ %s ]\n", opt, backendNames());
+        exit(EXIT_FAILURE);
+    };
+    for (int i = 0; i < nsinks; i++)
+        if (sinks[i]->be == sk->be) {
+            fprintf(stderr, "?Storage backend '%s' is listed twice\n", sk->be->name);
+            exit(EXIT_FAILURE);
+        };
+    sk->retry    = SPOOL_RETRY;
+    sk->batchMax = bulkLoad ? IMPORT_BATCH : SPOOL_BATCH;
+    while ( (opt = strtok_r(NULL, ":", &save)) != NULL ) {
+        if (sscanf(opt, "retry=%d", &sk->retry) == 1 && sk->retry > 0) continue;
+        if (sscanf(opt, "batch=%d", &sk->batchMax) == 1 && sk->batchMax > 0) continue;
+        fprintf(stderr, "?Invalid option '%s' for backend '%s': use retry=<sec> or batch=<n>\n",
+                opt, sk->be->name);
+        exit(EXIT_FAILURE);
+    };
+    sk->primary  = (nsinks == 0) && !bulkLoad;
+    sk->pending  = &sk->batch[0];
+    sk->inflight = &sk->batch[1];
+    pthread_mutex_init(&sk->lock, NULL);
+    sk->ev  = evNew();
+    sk->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ( (sk->efd < 0) || !evAddFd(sk->ev, sk->efd, EPOLLIN, sinkEvent, sk) ) {
+        fprintf(stderr, "?WDL_433: can't create queue for backend '%s'\n", sk->be->name);
+        exit(EXIT_FAILURE);
+    };
+    sinks[nsinks++] = sk;
+
+    // Check for the database, and open the spool for records it can't take
+    LOG(LM_DB, LV_DEBUG, "Using storage backend '%s', retry %d sec, batch %d\n",
+        sk->be->name, sk->retry, sk->batchMax);
+    sk->dbUp = (sk->be->init == NULL) || sk->be->init(sk);
+    if ( (spoolFile != NULL) && (*spoolFile != '\0') ) {
+        if (sk->primary)
+            snprintf(path, sizeof(path), "%s", spoolFile);
+        else
+            snprintf(path, sizeof(path), "%s.%s", spoolFile, sk->be->name);
+        sk->spool = spoolOpen(path);
+        if (sk->spool == NULL)
+            LOG(LM_SPOOL, LV_WARN, "%s: no spool: records the database can't take will be lost\n",
+                sk->be->name);
+    };
+    if ( (spoolCount(sk->spool) > 0) || !sk->dbUp ) storeRetry(sk, 1);
+};
+
+// Set up a sink for each backend named in 'backend'
+void storeInit(void) {
+    char *list, *desc, *save;
+    if ( (list = strdup(backend)) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for backend list\n");
+        exit(EXIT_FAILURE);
+    };
+    for (desc = strtok_r(list, ", \t", &save); desc != NULL; desc = strtok_r(NULL, ", \t", &save))
+        sinkNew(desc);
+    free(list);
+    if (nsinks == 0) {
+        fprintf(stderr, "?No storage backend: use [ %s ]\n", backendNames());
+        exit(EXIT_FAILURE);
+    };
+    commitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ( (commitFd < 0) || !evAddFd(mainLoop, commitFd, EPOLLIN, commitEvent, NULL) ) {
+        fprintf(stderr, "?WDL_433: can't create storage commit queue\n");
+        exit(EXIT_FAILURE);
+    };
+};
+
+// Start the sinks' writer threads (once the registry has been restored,
+//   which may read from the primary backend)
+void storeStart(void) {
+    for (int i = 0; i < nsinks; i++)
+        if (pthread_create(&sinks[i]->thread, NULL, sinkThread, sinks[i]) != 0) {
+            fprintf(stderr, "?WDL_433: can't start writer thread for backend '%s'\n",
+                    sinks[i]->be->name);
+            exit(EXIT_FAILURE);
+        };
+};
+
+// Stop the sinks once they have sent or spooled everything handed to them
+void storeClose(void) {
+    for (int i = 0; i < nsinks; i++) {
+        pthread_mutex_lock(&sinks[i]->lock);
+        sinks[i]->stopping = true;
+        pthread_mutex_unlock(&sinks[i]->lock);
+        wake(sinks[i]->efd);
+    };
+    for (int i = 0; i < nsinks; i++) {
+        pthread_join(sinks[i]->thread, NULL);
+        evFree(sinks[i]->ev);
+        close(sinks[i]->efd);
+    };
+    commitEvent(commitFd, EPOLLIN, NULL);
+    if (nsinks > 0) recorded = sinks[0]->committed;
+    nsinks = 0;
+};
+
+// Hand a record to every sink
+void storeRecord(DBRecord *DBRow) {
+    for (int i = 0; i < nsinks; i++) {
+        sink_t *sk = sinks[i];
+        bool first;
+        pthread_mutex_lock(&sk->lock);
+        first = (sk->handoff.count == 0);
+        batchAdd(&sk->handoff, DBRow, 1);
+        if (sk->handoff.count == SINK_QUEUE)
+            LOG(LM_SPOOL, LV_WARN, "%s: writer is falling behind: %d records queued\n",
+                sk->be->name, SINK_QUEUE);
+        pthread_mutex_unlock(&sk->lock);
+        if (first) wake(sk->efd);
+    };
+};
+
+// Most records waiting for any one sink (for pacing bulk imports)
+long storeBacklog(void) {
+    long most = 0, n;
+    for (int i = 0; i < nsinks; i++) {
+        pthread_mutex_lock(&sinks[i]->lock);
+        n = sinks[i]->handoff.count;
+        pthread_mutex_unlock(&sinks[i]->lock);
+        n += __atomic_load_n(&sinks[i]->backlog, __ATOMIC_RELAXED);
+        if (n > most) most = n;
+    };
+    return most;
+};
+
+// Is the backend 'name' the primary sink's, whose commits are reported?
+bool storePrimary(const char *name) {
+    return (nsinks > 0) && (strcmp(sinks[0]->be->name, name) == 0);
+};
+
+// Records committed by the first sink
+unsigned long storeCount(void) {
+    return (nsinks > 0) ? __atomic_load_n(&sinks[0]->committed, __ATOMIC_RELAXED) : recorded;
+};
+
+// Pass the sensorID and time of the latest row for each sensor to 'cb'
+//   (used to restore the sensor registry when there is no saved state)
+void dbLastTimes(void (*cb)(char *sensorID, char *date_time)) {
+    if ( (nsinks > 0) && (sinks[0]->be->lastTimes != NULL) )
+        sinks[0]->be->lastTimes(cb);
+};
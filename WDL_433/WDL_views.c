@@ -0,0 +1,313 @@
+/* -*- mode: c++ ; indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*- */
+/*  WDL_views.c
+    Materialized chart views for WWW_433, from WDL_433, weather data
+    logger for rtl_433
+
+    Most page views ask for the same few charts.  Each entry in the
+    [views] section of WDL_433.ini names a chart, in the form of a
+    chart-data request (see WDL_http.c), e.g.
+        [views]
+        deck-24h  = series=Deck:temp1,Deck:rh&hours=24&bin=5m
+        deck-10d  = series=Deck:temp1,Deck:rh&hours=240&bin=15m&points=500
+        deck-year = series=Deck:temp1,Office:temp1&hours=8760&bin=3h
+    and WDL_433 keeps '<viewdir>/<name>.json.gz' up to date with the
+    gzipped JSON reply to that request, so the web server can serve the
+    chart as a static file.  The request is parsed and the reply written
+    by WDL_chart.c, as for the chart-data service, so a view is the same
+    JSON, "last" included, as /chart?<request> gives.  A view must give
+    'bin', and its range is 'hours' (not 'from', 'to' or 'since').
+
+    A view is a ring of the bins in its range, indexed by bin number,
+    so it takes the same memory however long the range.  It's filled
+    from the sqlite3 database at startup, then each reading is added to
+    its bin as the primary backend commits it (so sqlite3 must be the
+    first backend, the primary one), and the bins that have aged out of
+    the range are dropped as time passes; the database isn't read
+    again.  A view that has changed is rewritten once the records
+    committed with the change have been handled, or every VIEW_TICK sec
+    as bins age out, by writing '.<name>.json.gz' and renaming it over
+    '<name>.json.gz', so a reader never sees a part-written file.
+
+    HDTodd@gmail.com, 2025.07
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+#include <zlib.h>
+
+#include "WDL_433.h"
+#include "WDL_chart.h"
+
+extern char *viewDir;
+extern char *backend;
+extern char *sql3path;
+extern char *sql3file;
+
+#define VIEW_TICK    60           // sec between checks for bins aged out
+
+// One bin of a view
+typedef struct {
+    int64_t bin;                  // its number, from 1970; -1 if unused
+    int     n[CHART_SERIES];
+    double  sum[CHART_SERIES];
+} vslot_t;
+
+typedef struct view {
+    char        *name;
+    char        *request;         // parsed into 'q', which points into it
+    chartreq_t   q;
+    int          nslots;          // bins in the range
+    vslot_t     *slot;            // indexed by bin number, modulo 'nslots'
+    char         latest[24];      // the latest reading added
+    bool         dirty;           // changed since it was written
+    int64_t      written;         // the latest bin when it was written
+    struct view *next;
+} view_t;
+
+static view_t *views = NULL, *viewsTail = NULL;
+static hbuf_t  json;              // a view's JSON, and its gzipped form
+static Bytef  *zbuf = NULL;
+static uLong   zmax = 0;
+static bool    viewsOpen = false;
+
+static void viewError(char *name, const char *what) {
+    fprintf(stderr, "?WDL_433: invalid [views] entry '%s': %s\n"
+            "\tuse e.g. 'series=Deck:temp1,Deck:rh&hours=240&bin=5m'\n", name, what);
+    exit(EXIT_FAILURE);
+};
+
+// Record the view in the [views] entry 'name = request'
+void setView(char *name, char *request) {
+    view_t     *v;
+    const char *err;
+
+    if ( (v = calloc(1, sizeof(view_t))) == NULL ) {
+        fprintf(stderr, "?WDL_433: out of memory for views\n");
+        exit(EXIT_FAILURE);
+    };
+    if ( (*name == '\0') || (strchr(name, '/') != NULL) || (name[0] == '.') )
+        viewError(name, "the name must be a file name");
+    v->name    = strdup(name);
+    v->request = strdup(request);
+    if ( (err = chartParse(v->request, &v->q)) != NULL ) viewError(name, err);
+    if (v->q.bin == 0) viewError(name, "a view needs 'bin'");
+    if ( (v->q.from[0] != '\0') || (v->q.to[0] != '\0') || (v->q.since >= 0) )
+        viewError(name, "a view's range is 'hours', not 'from', 'to' or 'since'");
+    v->nslots = chartBins(&v->q);
+    if (viewsTail == NULL) views = v;
+    else                   viewsTail->next = v;
+    viewsTail = v;
+};
+
+// Add the value 'val' of series 's', read at 'dt', to 'v'
+static void viewAdd(view_t *v, int s, const char *dt, double val, int64_t now) {
+    int64_t  b = dtSeconds(dt)/v->q.bin;
+    vslot_t *sl;
+    if ( (b <= now/v->q.bin - v->nslots) || (b > now/v->q.bin) ) return;
+    sl = &v->slot[b % v->nslots];
+    if (sl->bin != b) {
+        memset(sl, 0, sizeof(vslot_t));
+        sl->bin = b;
+    };
+    sl->n[s]++;
+    sl->sum[s] += val;
+    if (strcmp(dt, v->latest) > 0) snprintf(v->latest, sizeof(v->latest), "%s", dt);
+    v->dirty = true;
+};
+
+static double rowValue(DBRecord *row, int f) {
+    switch (f) {
+    case 0:  return row->temp1;
+    case 1:  return row->temp2;
+    case 2:  return row->rh;
+    case 3:  return row->press;
+    default: return row->light;
+    };
+};
+
+// Write 'v' as JSON, gzipped, to '<viewdir>/<name>.json.gz'
+static void viewWrite(view_t *v, int64_t now) {
+    char      path[PATH_MAX], tmp[PATH_MAX];
+    int64_t   last = now/v->q.bin;
+    chart_t   chart;
+    hrow_t    row;
+    z_stream  z;
+    int       fd, rc;
+
+    json.len = 0;
+    chartBegin(&chart, &json, &v->q, chartStart(&v->q, now), now);
+    for (int64_t b = last - v->nslots + 1; b <= last; b++) {
+        vslot_t *sl = &v->slot[b % v->nslots];
+        if (sl->bin != b) continue;
+        row.t = b*v->q.bin;
+        chartLabel(row.t, row.label);
+        for (int s = 0; s < v->q.nseries; s++) {
+            row.has[s] = (sl->n[s] > 0);
+            row.v[s]   = row.has[s] ? sl->sum[s]/sl->n[s] : 0;
+        };
+        chartRow(&chart, &row);
+    };
+    chartEnd(&chart, v->latest, -1);
+
+    // Gzip it, then put it in place
+    if (compressBound(json.len) + 32 > zmax) {           // and the gzip header and trailer
+        zmax = compressBound(json.len) + 32;
+        if ( (zbuf = realloc(zbuf, zmax)) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for views\n");
+            exit(EXIT_FAILURE);
+        };
+    };
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        LOG(LM_HTTP, LV_ERR, "Can't compress view '%s'\n", v->name);
+        return;
+    };
+    z.next_in   = (Bytef *)json.s;
+    z.avail_in  = json.len;
+    z.next_out  = zbuf;
+    z.avail_out = zmax;
+    rc = deflate(&z, Z_FINISH);
+    deflateEnd(&z);
+    if (rc != Z_STREAM_END) {
+        LOG(LM_HTTP, LV_ERR, "Can't compress view '%s'\n", v->name);
+        return;
+    };
+    snprintf(path, sizeof(path), "%s/%s.json.gz", viewDir, v->name);
+    snprintf(tmp,  sizeof(tmp),  "%s/.%s.json.gz", viewDir, v->name);
+    if ( (fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0 ) goto fail;
+    if (write(fd, zbuf, z.total_out) != (ssize_t)z.total_out) {
+        close(fd);
+        unlink(tmp);
+        goto fail;
+    };
+    close(fd);
+    if (rename(tmp, path) != 0) goto fail;
+    v->dirty   = false;
+    v->written = last;
+    return;
+fail:
+    LOG(LM_HTTP, LV_ERR, "Can't write view '%s': %s\n", path, strerror(errno));
+};
+
+// Fill the views from the sqlite3 database
+static void viewLoad(int64_t now) {
+    sqlite3      *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    char          path[FNLEN+1], from[24];
+
+    snprintf(path, sizeof(path), "%s/%s", sql3path, sql3file);
+    if ( (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+         || (sqlite3_prepare_v2(db, "SELECT date_time, temp1, temp2, rh, press, light FROM "
+                                DBTABLE " WHERE sensorID = ?1 AND date_time >= ?2",
+                                -1, &stmt, NULL) != SQLITE_OK) ) {
+        LOG(LM_HTTP, LV_WARN, "Can't read sqlite3 database '%s': %s: views start empty\n",
+            path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    };
+    for (view_t *v = views; v != NULL; v = v->next)
+        for (int s = 0; s < v->q.nseries; s++) {
+            chartLabel(chartStart(&v->q, now), from);
+            sqlite3_bind_text(stmt, 1, v->q.sensor[s], -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, from, -1, SQLITE_STATIC);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+                viewAdd(v, s, (const char *)sqlite3_column_text(stmt, 0),
+                        sqlite3_column_double(stmt, v->q.field[s] + 1), now);
+            sqlite3_reset(stmt);
+        };
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+};
+
+// Write the views that have changed, or had bins age out
+static void viewTimer(void *arg) {
+    int64_t now = chartNow();
+    for (view_t *v = views; v != NULL; v = v->next)
+        if (v->dirty || (now/v->q.bin != v->written)) viewWrite(v, now);
+};
+
+// Add a record the primary backend has committed to the views
+void viewRecord(DBRecord *DBRow) {
+    int64_t now;
+    if (!viewsOpen) return;            // not open, e.g. when importing
+    now = chartNow();
+    for (view_t *v = views; v != NULL; v = v->next)
+        for (int s = 0; s < v->q.nseries; s++)
+            if (strcmp(v->q.sensor[s], DBRow->sensorID) == 0)
+                viewAdd(v, s, DBRow->date_time, rowValue(DBRow, v->q.field[s]), now);
+};
+
+// Write the views changed by the records just committed
+void viewFlush(void) {
+    int64_t now;
+    if (!viewsOpen) return;
+    now = chartNow();
+    for (view_t *v = views; v != NULL; v = v->next)
+        if (v->dirty) viewWrite(v, now);
+};
+
+void viewOpen(void) {
+    struct stat st;
+    int64_t     now;
+
+    if (views == NULL) return;
+    if ( (viewDir == NULL) || (*viewDir == '\0') ) {
+        fprintf(stderr, "?WDL_433: [views] are given, but no 'viewdir' to write them to\n");
+        exit(EXIT_FAILURE);
+    };
+    if (!storePrimary("sqlite3")) {
+        fprintf(stderr, "?WDL_433: [views] are filled from the sqlite3 database: "
+                "list sqlite3 first in 'backend' (now '%s')\n", backend);
+        exit(EXIT_FAILURE);
+    };
+    if ( (stat(viewDir, &st) != 0) || !S_ISDIR(st.st_mode) ) {
+        fprintf(stderr, "?WDL_433: view directory '%s' doesn't exist\n", viewDir);
+        exit(EXIT_FAILURE);
+    };
+    for (view_t *v = views; v != NULL; v = v->next) {
+        if ( (v->slot = malloc(v->nslots*sizeof(vslot_t))) == NULL ) {
+            fprintf(stderr, "?WDL_433: out of memory for view '%s'\n", v->name);
+            exit(EXIT_FAILURE);
+        };
+        for (int i = 0; i < v->nslots; i++) v->slot[i].bin = -1;
+        v->written = -1;
+    };
+    viewsOpen = true;
+    now = chartNow();
+    viewLoad(now);
+    for (view_t *v = views; v != NULL; v = v->next) {
+        viewWrite(v, now);
+        LOG(LM_HTTP, LV_DEBUG, "View '%s/%s.json.gz': %d series, %ld hours in %d sec bins\n",
+            viewDir, v->name, v->q.nseries, v->q.hours, v->q.bin);
+    };
+    evTimer(mainLoop, VIEW_TICK*1000, true, viewTimer, NULL);
+};
+
+void viewClose(void) {
+    view_t *v;
+    viewFlush();
+    while ( (v = views) != NULL ) {
+        views = v->next;
+        free(v->name);
+        free(v->request);
+        free(v->slot);
+        free(v);
+    };
+    viewsTail = NULL;
+    free(json.s);
+    free(zbuf);
+    memset(&json, 0, sizeof(json));
+    zbuf = NULL;
+    zmax = 0;
+    viewsOpen = false;
+};
@@ -2,17 +2,18 @@
 /*  Template for a web page that displays the history of
         WeatherStation-collected temperature/humidity data as a graph
 
-    This script assumes the sqlite3 table SensorData was created with the command
-	CREATE TABLE SensorData (date_time TEXT, sensorID TEXT, temp1 REAL,
-	    temp2 REAL, rh REAL, press REAL, light REAL);
+    The data come from the chart-data service of WDL_433 (the 'http'
+    setting, e.g. 'http = 127.0.0.1:8433'), which the browser reaches
+    through the web server, e.g. for Apache, with mod_proxy_http enabled:
+        ProxyPass "/wdl/" "http://127.0.0.1:8433/" flushpackets=on
+    This page just renders the HTML; the browser fetches the data:
+        $CHART_URL?series=Deck:temp1,Deck:rh&hours=240
+    which returns
+        {"columns":["date_time","Deck:temp1","Deck:rh"],
+         "rows":[["2025-04-19 15:40:27",25.0,79],...]}
 
-    Then the fields selected for this script's table rows are:
-        field# [0]             [1]        [2]    [3]   [4]     [5]   |  [6]
-        date_time           | sensorID | temp1 |temp2 | rh  | press  | light
-        2025-04-19 15:40:27 | Office   | 25.0  | 0.0 | 1010.0 | 79.0
-
-    This version selects date_time, temp1, and rh for a specific sensorID
-        for display on the graph
+    This version displays date_time, temp1, and rh for a specific sensorID
+        on the graph
 
     Uses Google Charts for the display
     Written by HDTodd, January, 2016 borrowing heavily from numerous prior
@@ -21,33 +22,18 @@
         Google AJAX JQuery API 3.3.1 (https://developers.google.com/speed/libraries/)
     Updated 2025.04.21 for the WS_433 system, to present data collected by WDL_433
         from an ISM-band remote-sensor rtl_433 server
+    Updated 2025.07 to fetch the data from the WDL_433 chart-data service,
+        downsampled to the chart's width, then add new readings as they're
+        recorded
 */
-$HISTORY = "'-240 hours'";     //period of time over which to display temps
-$DB_LOC  = "/var/databases/";  //location of the sqlite3 db
-$DB_NAME = "Weather.db";       //name of sqlite3 db
-$SENSOR  = "Deck";             //sensor to report
-$DATA1   = "temp1";            //first data field to report
-$DATA2   = "rh";               //second data field to report
-
-$db = new PDO('sqlite:' . $DB_LOC . $DB_NAME) 
-      	  or die('Cannot open database ' . $DB_NAME);
-$query = "SELECT date_time, temp1, rh FROM SensorData " .
-              "WHERE sensorID='$SENSOR' AND date_time>datetime('now',$HISTORY)"; 
-foreach ($db->query($query) as $row)
-   $chart_array[]=array( (string)$row['date_time'],
-   			 round(1.8*(float)$row['temp1']+32.0,1),
-			 (float)$row['rh']); 
-
-//  Now get the latest entry to report as "current readings"
-$query = "SELECT date_time, temp1, rh FROM SensorData WHERE sensorID='$SENSOR' ORDER BY date_time  DESC LIMIT 1";
-foreach ($db->query($query) as $row) {
-  $last_time=(string)$row['date_time'];
-  $last_temp1=json_encode( round(1.8*(float)$row['temp1']+32.0,1));
-  $last_rh=json_encode( (float)$row['rh']);
-}
-
-//  Convert the table to a JSON array for the Javascript
-$temp_data=json_encode($chart_array);
+$HOURS     = 240;              //period of time, in hours, over which to display temps
+$POINTS    = 900;              //points per series: the chart's width in pixels
+$CHART_URL = "/wdl/chart";     //WDL_433 chart-data service, through the web server
+$VIEW_URL  = "";               //or a view WDL_433 keeps, e.g. "/wdl-views/deck-10d.json.gz"
+$STREAM_URL= "/wdl/stream";    //new readings as WDL_433 records them ("" = none)
+$SENSOR    = "Deck";           //sensor to report
+$DATA1     = "temp1";          //first data field to report
+$DATA2     = "rh";             //second data field to report
 ?>
 
 <!-- Here's the HTML code for the site, followed by the JS component for the chart
@@ -56,9 +42,9 @@ $temp_data=json_encode($chart_array);
 <html>
 <center style="font-family:Arial">
 <h1 style="font-family:Arial">The <?php echo gethostname() ?> Meterological Data Web Site</h1>
-<h2 style="font-family:Arial">Current conditions at <?php echo $last_time ?> for sensor '<?php echo $SENSOR ?>'</br> 
-<font color="red" >Temp: <?php echo round($last_temp1,1,PHP_ROUND_HALF_UP) ?>°F </font>and 
-<font color="blue">RH = <?php echo $last_rh ?>% </font></h2>
+<h2 style="font-family:Arial">Current conditions at <span id="last_time"></span> for sensor '<?php echo $SENSOR ?>'</br> 
+<font color="red" >Temp: <span id="last_temp1"></span>°F </font>and 
+<font color="blue">RH = <span id="last_rh"></span>% </font></h2>
 <p style="font-family:Arial">
   <head>
     <!--Load the AJAX API-->
@@ -69,24 +55,62 @@ $temp_data=json_encode($chart_array);
       google.load("visualization", "1", {packages:["corechart"]});
       google.setOnLoadCallback(drawChart);
       function drawChart() {
-        var data = new google.visualization.DataTable();
-        data.addColumn("string","DateTime");
-	data.addColumn("number","Temp1 (°F)");
-	data.addColumn("number","RH (%)");
-        data.addRows( <?php echo $temp_data ?>);
-        var options = {
-          title: 'Outside Temp and Humidity History',
-	  series: {
-	    0: {targetAxisIndex: 0, color: 'red'},
-	    1: {targetAxisIndex: 1, color: 'blue'}
-	  },
-	  vAxes: {
-	    0: {title: 'Temp (°F)'},
-	    1: {title: 'RH (%)'}
-	  }  
-        };
-        var chart = new google.visualization.LineChart(document.getElementById('chart_div'));
-        chart.draw(data, options);
+<?php if ($VIEW_URL != "") { ?>
+        $.getJSON("<?php echo $VIEW_URL ?>",
+<?php } else { ?>
+        $.getJSON("<?php echo $CHART_URL ?>",
+                  {series: "<?php echo "$SENSOR:$DATA1,$SENSOR:$DATA2" ?>", hours: <?php echo $HOURS ?>,
+                   points: <?php echo $POINTS ?>},
+<?php } ?>
+                  function(chart) {
+          // Temperatures are recorded in °C
+          var rows = chart.rows.map(function(r) {
+            return [r[0], (r[1] === null) ? null : Math.round(18*r[1]+320)/10, r[2]];
+          });
+          if (rows.length > 0) {
+            var last = rows[rows.length-1];
+            $("#last_time").text(last[0]);
+            $("#last_temp1").text(last[1]);
+            $("#last_rh").text(last[2]);
+          }
+          var data = new google.visualization.DataTable();
+          data.addColumn("string","DateTime");
+          data.addColumn("number","Temp1 (°F)");
+          data.addColumn("number","RH (%)");
+          data.addRows(rows);
+          var options = {
+            title: 'Outside Temp and Humidity History',
+            series: {
+              0: {targetAxisIndex: 0, color: 'red'},
+              1: {targetAxisIndex: 1, color: 'blue'}
+            },
+            vAxes: {
+              0: {title: 'Temp (°F)'},
+              1: {title: 'RH (%)'}
+            }
+          };
+          var chart = new google.visualization.LineChart(document.getElementById('chart_div'));
+          chart.draw(data, options);
+<?php if ($STREAM_URL != "") { ?>
+          // Add each reading as it's recorded, and drop those that have aged
+          // out of the chart's range
+          var stream = new EventSource("<?php echo $STREAM_URL ?>?sensors=" +
+                                       encodeURIComponent("<?php echo $SENSOR ?>"));
+          stream.addEventListener("reading", function(e) {
+            var r = JSON.parse(e.data);
+            var row = [r.date_time, Math.round(18*r.<?php echo $DATA1 ?>+320)/10, r.<?php echo $DATA2 ?>];
+            var oldest = new Date(Date.now() - <?php echo $HOURS ?>*3600*1000);
+            data.addRow(row);
+            while ( (data.getNumberOfRows() > 1) &&
+                    (new Date(data.getValue(0, 0).replace(" ", "T")) < oldest) )
+              data.removeRow(0);
+            $("#last_time").text(row[0]);
+            $("#last_temp1").text(row[1]);
+            $("#last_rh").text(row[2]);
+            chart.draw(data, options);
+          });
+<?php } ?>
+        });
       }
     </script>
   </head>